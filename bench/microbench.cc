@@ -0,0 +1,454 @@
+/*
+ *------------------------------------------------------------------------------
+ *
+ * microbench.cc
+ *
+ * Microbenchmarks of project keymouse
+ *
+ * Times the hot pieces of the daemon in isolation: framework::Config parsing
+ * (from the file and from the cache) and its getters, the dbug macro at every
+ * level, and one tick of the key state, motion and click logic of the polling
+ * loop, fed synthetic keyboard states and sending to the simulator. Every
+ * benchmark runs a fixed number of iterations a few times over, and the best
+ * run is reported as one JSON object per line on stdout, with the time and the
+ * heap allocations per operation.
+ *
+ * Usage: microbench
+ *
+ * Copyright (c) 2017 Zoltan Toth <ztoth AT thetothfamily DOT net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *------------------------------------------------------------------------------
+ */
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <new>
+#include <cstdlib>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "framework.h"
+#include "bindings.h"
+#include "motion.h"
+#include "sim.h"
+
+/** runs of every benchmark, the best one is reported */
+#define RUNS 5
+
+/** dbug records per run, less than the log ring holds */
+#define LOG_BATCH 1000
+
+/** synthetic keyboard states the tick benchmark cycles through */
+#define TICK_FRAMES 64
+
+/** tick period of the tick benchmark, the default "sleep" */
+#define TICK_PERIOD_NS 7500000ULL
+
+/** heap allocations of this thread, the logger thread is not counted */
+static __thread uint64_t allocations = 0;
+
+/**
+ * Count every allocation made through new
+ */
+void*
+operator new (size_t size)
+{
+    allocations++;
+    void *ptr = malloc(size ? size : 1);
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void*
+operator new[] (size_t size)
+{
+    return operator new(size);
+}
+
+void
+operator delete (void *ptr) noexcept
+{
+    free(ptr);
+}
+
+void
+operator delete[] (void *ptr) noexcept
+{
+    free(ptr);
+}
+
+/** one benchmark */
+typedef struct bench_s {
+    const char *name;
+    int iterations;
+    void (*setup) (void);                         /** before every run, NULL */
+    void (*body) (int i);                         /** one operation */
+} bench_t;
+
+/** keeps the compiler from optimizing the results away */
+static volatile uint64_t sink;
+
+/** where the results go, std::cout takes the log output */
+static std::ostream *out;
+
+/** config under test, its copy, and keywords it does not have */
+static framework::Config *config = NULL;
+static std::string config_paths[2];
+static std::vector<std::string> missing;
+
+/** state of the tick benchmark */
+static Bindings tick_bindings;
+static Motion tick_motion;
+static SimOutput tick_output(960, 540);
+static keyset_t tick_frames[TICK_FRAMES];
+static keyset_t tick_prev;
+static uint64_t tick_now;
+
+/**
+ * Write the config file the config benchmarks parse
+ *
+ * The same keys as cfg/default.cfg, with a second section in front of ours.
+ */
+static bool
+write_config (const std::string &path)
+{
+    std::ofstream file(path.c_str());
+    file << "{\n"
+         << "    \"other\" : {\n"
+         << "        \"name\" : \"value\"\n"
+         << "    },\n"
+         << "    \"keymouse\" : {\n"
+         << "        \"trigger\" : \"Menu\",\n"
+         << "        \"up\" : \"W\",\n"
+         << "        \"left\" : \"A\",\n"
+         << "        \"down\" : \"S\",\n"
+         << "        \"right\" : \"D\",\n"
+         << "        \"click\" : \"F\",\n"
+         << "        \"paste\" : \"G\",\n"
+         << "        \"speed\" : \"12\",\n"
+         << "        \"sleep\" : \"7500\",\n"
+         << "        \"slow\" : \"Alt_L\",\n"
+         << "        \"accel\" : \"none\",\n"
+         << "        \"accel_time\" : \"500\",\n"
+         << "        \"max_speed\" : \"3200\",\n"
+         << "        \"scroll_speed\" : \"10\",\n"
+         << "        \"scroll_max_speed\" : \"40\",\n"
+         << "        \"edges\" : \"clamp\",\n"
+         << "        \"relative\" : \"false\",\n"
+         << "        \"numlock\" : \"true\",\n"
+         << "        \"reactor\" : \"true\",\n"
+         << "        \"xinput2\" : \"false\"\n"
+         << "    }\n"
+         << "}\n";
+    return file.good();
+}
+
+/**
+ * Parse the config again before a run, so every lookup of a run is a miss
+ */
+static void
+setup_config (void)
+{
+    delete config;
+    config = new framework::Config("keymouse");
+}
+
+static void
+bench_config_construct (int i)
+{
+    framework::Config parsed("keymouse");
+    sink += i;
+}
+
+/**
+ * Switch between two copies of the file, so every Config parses it again
+ */
+static void
+bench_config_parse (int i)
+{
+    framework::config_file = config_paths[i & 1];
+    framework::Config parsed("keymouse");
+    sink += i;
+}
+
+static void
+bench_get_string (int i)
+{
+    sink += config->get_string("trigger").size();
+}
+
+static void
+bench_get_int (int i)
+{
+    sink += config->get_int("speed");
+}
+
+static void
+bench_get_bool (int i)
+{
+    sink += config->get_bool("numlock");
+}
+
+static void
+bench_get_int_miss (int i)
+{
+    sink += config->get_int(missing[i].c_str());
+}
+
+/**
+ * Let the logger thread empty the ring before a run
+ */
+static void
+setup_log (void)
+{
+    struct timespec ts = {0, 50000000L};
+    nanosleep(&ts, NULL);
+}
+
+static void
+bench_dbug_error (int i)
+{
+    dbug(DEBUG_LEVEL_ERROR, DEBUG_TYPE_FRAMEWORK,
+         "tick " << i << " pointer at " << 960 << "," << 540);
+}
+
+static void
+bench_dbug_warning (int i)
+{
+    dbug(DEBUG_LEVEL_WARNING, DEBUG_TYPE_FRAMEWORK,
+         "tick " << i << " pointer at " << 960 << "," << 540);
+}
+
+static void
+bench_dbug_normal (int i)
+{
+    dbug(DEBUG_LEVEL_NORMAL, DEBUG_TYPE_FRAMEWORK,
+         "tick " << i << " pointer at " << 960 << "," << 540);
+}
+
+static void
+bench_dbug_verbose (int i)
+{
+    dbug(DEBUG_LEVEL_VERBOSE, DEBUG_TYPE_FRAMEWORK,
+         "tick " << i << " pointer at " << 960 << "," << 540);
+}
+
+static void
+bench_dbug_very_verbose (int i)
+{
+    dbug(DEBUG_LEVEL_VERY_VERBOSE, DEBUG_TYPE_FRAMEWORK,
+         "tick " << i << " pointer at " << 960 << "," << 540);
+}
+
+/**
+ * Bind the keys of cfg/default.cfg and script the keyboard states
+ *
+ * The keycodes are those of a US keyboard. The mouse keeps moving right,
+ * goes down now and then, clicks, pastes and slows down every so often.
+ */
+static void
+setup_tick (void)
+{
+    tick_bindings = Bindings();
+    tick_bindings.add(25, ACTION_MOVE, UP);
+    tick_bindings.add(38, ACTION_MOVE, LEFT);
+    tick_bindings.add(39, ACTION_MOVE, DOWN);
+    tick_bindings.add(40, ACTION_MOVE, RIGHT);
+    tick_bindings.add(41, ACTION_BUTTON, 1);
+    tick_bindings.add(42, ACTION_TAP, 2);
+    tick_bindings.add(64, ACTION_GEAR, GEAR_SLOW);
+    tick_bindings.compile();
+
+    motion_config_t motion;
+    motion.speed = 1600.0;
+    motion.max_speed = 3200.0;
+    motion.slow_speed = 133.0;
+    motion.accel_time = 0.5;
+    motion.curve = ACCEL_LINEAR;
+    tick_motion.configure(motion);
+    tick_motion.stop();
+
+    for (int i = 0; i < TICK_FRAMES; i++) {
+        keyset_t &keys = tick_frames[i];
+        keyset_clear(keys);
+        keyset_set(keys, 40, (i % 16) < 12);
+        keyset_set(keys, 39, (i % 8) < 4);
+        keyset_set(keys, 41, ((i % 32) >= 8) && ((i % 32) < 12));
+        keyset_set(keys, 42, (i % 32) == 20);
+        keyset_set(keys, 64, (i % 64) >= 48);
+    }
+    keyset_clear(tick_prev);
+    tick_now = 0;
+}
+
+/**
+ * One tick: resolve the held keys, click, and move the mouse one step
+ */
+static void
+bench_tick (int i)
+{
+    const keyset_t &held = tick_frames[i % TICK_FRAMES];
+    actions_t actions;
+    tick_bindings.resolve(held, tick_prev, actions);
+    tick_prev = held;
+
+    for (int code = keyset_pop(actions.pressed); code >= 0;
+         code = keyset_pop(actions.pressed)) {
+        const binding_t &binding = tick_bindings.lookup(code);
+        if (ACTION_BUTTON == binding.type) {
+            tick_output.fake_button(binding.arg, true);
+        }
+    }
+    for (int code = keyset_pop(actions.released); code >= 0;
+         code = keyset_pop(actions.released)) {
+        const binding_t &binding = tick_bindings.lookup(code);
+        if (ACTION_TAP == binding.type) {
+            tick_output.fake_button(binding.arg, true);
+        }
+        tick_output.fake_button(binding.arg, false);
+    }
+
+    int dir_x = (RIGHT & actions.move) ? 1 : (LEFT & actions.move) ? -1 : 0;
+    int dir_y = (DOWN & actions.move) ? 1 : (UP & actions.move) ? -1 : 0;
+    tick_now += TICK_PERIOD_NS;
+    if (dir_x || dir_y) {
+        int dx, dy;
+        tick_motion.step(dir_x, dir_y, actions.gear, tick_now, dx, dy);
+        tick_output.warp_pointer((tick_output.x + dx) % 1920,
+                                 (tick_output.y + dy) % 1080);
+    } else {
+        tick_motion.stop();
+    }
+}
+
+/**
+ * Run a benchmark and print its best run
+ */
+static void
+run (const bench_t &bench)
+{
+    uint64_t best_ns = 0;
+    uint64_t best_allocs = 0;
+    for (int run = 0; run < RUNS; run++) {
+        if (bench.setup) {
+            bench.setup();
+        }
+        uint64_t allocs = allocations;
+        uint64_t start = framework::monotonic_ns();
+        for (int i = 0; i < bench.iterations; i++) {
+            bench.body(i);
+        }
+        uint64_t elapsed = framework::monotonic_ns() - start;
+        allocs = allocations - allocs;
+        if (!run || (elapsed < best_ns)) {
+            best_ns = elapsed;
+        }
+        if (!run || (allocs < best_allocs)) {
+            best_allocs = allocs;
+        }
+    }
+
+    *out << "{\"bench\": \"" << bench.name << "\", \"iterations\": "
+         << bench.iterations << ", \"ns_per_op\": "
+         << (double)best_ns / bench.iterations << ", \"allocs_per_op\": "
+         << (double)best_allocs / bench.iterations << "}" << std::endl;
+}
+
+/**
+ * Main function
+ */
+int
+main (int argc, char *argv[])
+{
+    /* the results go where std::cout went, the log records nowhere */
+    std::ostream results(std::cout.rdbuf());
+    out = &results;
+    std::ofstream devnull("/dev/null");
+    std::cout.rdbuf(devnull.rdbuf());
+
+    for (int i = 0; i < 2; i++) {
+        char path[] = "/tmp/keymouse-microbench-XXXXXX";
+        int fd = mkstemp(path);
+        if (fd >= 0) {
+            close(fd);
+            config_paths[i] = path;
+        }
+        if ((fd < 0) || !write_config(path)) {
+            std::cerr << "cannot create a config file" << std::endl;
+            return 1;
+        }
+    }
+    framework::config_file = config_paths[0];
+
+    /* parse without the per-pair log records, they are timed separately */
+    framework::debug_level = DEBUG_LEVEL_WARNING;
+    for (int i = 0; i < 100000; i++) {
+        std::stringstream keyword;
+        keyword << "missing_" << i;
+        missing.push_back(keyword.str());
+    }
+    setup_config();
+
+    static const bench_t config_benches[] = {
+        { "config_parse",        2000,   NULL,         bench_config_parse },
+        { "config_construct",    2000,   NULL,         bench_config_construct },
+        { "config_get_string",   100000, NULL,         bench_get_string },
+        { "config_get_int",      100000, NULL,         bench_get_int },
+        { "config_get_bool",     100000, NULL,         bench_get_bool },
+        { "config_get_int_miss", 100000, setup_config, bench_get_int_miss }
+    };
+    for (size_t i = 0;
+         i < sizeof(config_benches) / sizeof(config_benches[0]); i++) {
+        framework::config_file = config_paths[0];
+        run(config_benches[i]);
+    }
+    delete config;
+    config = NULL;
+    unlink(config_paths[0].c_str());
+    unlink(config_paths[1].c_str());
+
+    /* the daemon logs at the normal level unless -v is given */
+    framework::debug_level = DEBUG_LEVEL_NORMAL;
+    framework::log_start();
+    static const bench_t log_benches[] = {
+        { "dbug_error",          LOG_BATCH, setup_log, bench_dbug_error },
+        { "dbug_warning",        LOG_BATCH, setup_log, bench_dbug_warning },
+        { "dbug_normal",         LOG_BATCH, setup_log, bench_dbug_normal },
+        { "dbug_verbose",        LOG_BATCH, setup_log, bench_dbug_verbose },
+        { "dbug_very_verbose",   LOG_BATCH, setup_log, bench_dbug_very_verbose }
+    };
+    for (size_t i = 0; i < sizeof(log_benches) / sizeof(log_benches[0]); i++) {
+        run(log_benches[i]);
+    }
+    framework::log_stop();
+    if (framework::log_dropped()) {
+        std::cerr << framework::log_dropped() << " log records dropped, "
+                  << "the dbug numbers include the drop path" << std::endl;
+    }
+
+    static const bench_t tick_benches[] = {
+        { "tick",                1000000, setup_tick,  bench_tick }
+    };
+    run(tick_benches[0]);
+
+    std::cout.rdbuf(results.rdbuf());
+    return 0;
+}
@@ -0,0 +1,405 @@
+/*
+ *------------------------------------------------------------------------------
+ *
+ * xvfb_bench.cc
+ *
+ * End-to-end latency and CPU benchmark of project keymouse
+ *
+ * Starts a private Xvfb server, then runs keymouse against it for every
+ * sleep/speed pair of the sweep, both with the polling and the reactor loop.
+ * Key presses are injected with XTest, and the time until the pointer moves is
+ * measured from the outside, just like a user would see it. The CPU time of
+ * the daemon is read from /proc while the mouse is grabbed but idle, and while
+ * it is moving. Every run prints one JSON object per line on stdout, progress
+ * goes to stderr.
+ *
+ * Usage: xvfb_bench [-d :display] [-n samples] [path to keymouse]
+ *
+ * Copyright (c) 2017 Zoltan Toth <ztoth AT thetothfamily DOT net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *------------------------------------------------------------------------------
+ */
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <csignal>
+#include <cstdlib>
+#include <cstdio>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <X11/Xlib.h>
+#include <X11/keysym.h>
+#include <X11/extensions/XTest.h>
+
+/** sweep of the config values */
+static const int sleeps[] = {2500, 5000, 7500, 15000};
+static const int speeds[] = {1, 4, 12};
+
+/** how long the CPU time is sampled, in msec */
+#define CPU_SAMPLE_MSEC 2000
+
+/** give up waiting for the pointer to move after this many msec */
+#define MOVE_TIMEOUT_MSEC 1000
+
+/**
+ * Get the monotonic clock in nanoseconds
+ */
+static uint64_t
+now_ns (void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+/**
+ * Sleep for the given number of milliseconds
+ */
+static void
+sleep_ms (int msec)
+{
+    struct timespec ts = {msec / 1000, (msec % 1000) * 1000000L};
+    while (nanosleep(&ts, &ts) < 0) {
+    }
+}
+
+/**
+ * Start a program in the background, with its output thrown away
+ */
+static pid_t
+spawn (const std::vector<std::string> &args, const char *display)
+{
+    pid_t pid = fork();
+    if (0 == pid) {
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        if (display) {
+            setenv("DISPLAY", display, 1);
+        }
+
+        std::vector<char*> argv;
+        for (size_t i = 0; i < args.size(); i++) {
+            argv.push_back(const_cast<char*>(args[i].c_str()));
+        }
+        argv.push_back(NULL);
+        execvp(argv[0], &argv[0]);
+        _exit(127);
+    }
+    return pid;
+}
+
+/**
+ * Stop a program started by spawn()
+ */
+static void
+stop (pid_t pid, int signal)
+{
+    if (pid > 0) {
+        kill(pid, signal);
+        waitpid(pid, NULL, 0);
+    }
+}
+
+/**
+ * CPU time used by a process so far, in nanoseconds
+ *
+ * The scheduler statistics are precise, the clock ticks of /proc/pid/stat are
+ * only used if they are not available.
+ */
+static uint64_t
+cpu_time_ns (pid_t pid)
+{
+    std::stringstream path;
+    path << "/proc/" << pid << "/schedstat";
+    std::ifstream schedstat(path.str().c_str());
+    uint64_t runtime;
+    if (schedstat >> runtime) {
+        return runtime;
+    }
+
+    path.str("");
+    path << "/proc/" << pid << "/stat";
+    std::ifstream stat(path.str().c_str());
+    std::string line;
+    std::getline(stat, line);
+
+    /* utime and stime are the 14th and 15th fields, after the command name */
+    std::stringstream fields(line.substr(line.rfind(')') + 2));
+    std::string field;
+    uint64_t utime = 0, stime = 0;
+    for (int i = 3; (i <= 15) && (fields >> field); i++) {
+        if (14 == i) {
+            utime = strtoull(field.c_str(), NULL, 10);
+        } else if (15 == i) {
+            stime = strtoull(field.c_str(), NULL, 10);
+        }
+    }
+    return (utime + stime) * (1000000000ULL / sysconf(_SC_CLK_TCK));
+}
+
+/**
+ * CPU time used by a process per second of wall time, in msec
+ */
+static double
+cpu_ms_per_sec (pid_t pid, int msec)
+{
+    uint64_t start = now_ns();
+    uint64_t cpu = cpu_time_ns(pid);
+    sleep_ms(msec);
+    uint64_t used = cpu_time_ns(pid) - cpu;
+    return (used / 1e6) / ((now_ns() - start) / 1e9);
+}
+
+/**
+ * Get the pointer position
+ */
+static void
+query_pointer (Display *display, int &x, int &y)
+{
+    Window tmpwin1, tmpwin2;
+    int tmp_x, tmp_y;
+    unsigned int mask;
+    XQueryPointer(display, DefaultRootWindow(display), &tmpwin1, &tmpwin2, &x,
+                  &y, &tmp_x, &tmp_y, &mask);
+}
+
+/**
+ * Press or release a key through XTest
+ */
+static void
+fake_key (Display *display, KeyCode code, bool press)
+{
+    XTestFakeKeyEvent(display, code, press, CurrentTime);
+    XSync(display, False);
+}
+
+/**
+ * Press the direction key and measure the time until the pointer moves
+ *
+ * Returns the latency in usec, or -1 if the pointer did not move at all.
+ */
+static int64_t
+measure_latency (Display *display, KeyCode key)
+{
+    /* start from the middle, so the pointer never sticks at an edge */
+    Window root = DefaultRootWindow(display);
+    XWarpPointer(display, None, root, 0, 0, 0, 0,
+                 DisplayWidth(display, DefaultScreen(display)) / 2,
+                 DisplayHeight(display, DefaultScreen(display)) / 2);
+    XSync(display, False);
+
+    int x0, y0, x, y;
+    query_pointer(display, x0, y0);
+
+    uint64_t start = now_ns();
+    fake_key(display, key, true);
+    int64_t latency = -1;
+    do {
+        query_pointer(display, x, y);
+        if ((x != x0) || (y != y0)) {
+            latency = (now_ns() - start) / 1000;
+            break;
+        }
+    } while (now_ns() - start < MOVE_TIMEOUT_MSEC * 1000000ULL);
+    fake_key(display, key, false);
+
+    /* let the daemon settle before the next sample */
+    sleep_ms(50);
+    return latency;
+}
+
+/**
+ * Get a percentile of the sorted samples
+ */
+static int64_t
+percentile (const std::vector<int64_t> &sorted, double p)
+{
+    if (sorted.empty()) {
+        return -1;
+    }
+    size_t rank = (size_t)(p / 100.0 * (sorted.size() - 1) + 0.5);
+    return sorted[rank];
+}
+
+/**
+ * Write a config file for one run
+ */
+static bool
+write_config (const std::string &path, int sleep, int speed, bool reactor)
+{
+    std::ofstream file(path.c_str());
+    file << "{\n"
+         << "    \"keymouse\" : {\n"
+         << "        \"trigger\" : \"F12\",\n"
+         << "        \"right\" : \"D\",\n"
+         << "        \"speed\" : \"" << speed << "\",\n"
+         << "        \"sleep\" : \"" << sleep << "\",\n"
+         << "        \"numlock\" : \"false\",\n"
+         << "        \"reactor\" : \"" << (reactor ? "true" : "false") << "\"\n"
+         << "    }\n"
+         << "}\n";
+    return file.good();
+}
+
+/**
+ * Run keymouse with one config and print the results
+ */
+static bool
+run (Display *display, const char *display_name, const std::string &keymouse,
+     int sleep, int speed, bool reactor, int samples)
+{
+    char path[] = "/tmp/keymouse-bench-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        return false;
+    }
+    close(fd);
+    if (!write_config(path, sleep, speed, reactor)) {
+        unlink(path);
+        return false;
+    }
+
+    std::vector<std::string> args;
+    args.push_back(keymouse);
+    args.push_back("-c");
+    args.push_back(path);
+    pid_t pid = spawn(args, display_name);
+
+    KeyCode trigger = XKeysymToKeycode(display, XK_F12);
+    KeyCode right = XKeysymToKeycode(display, XK_d);
+
+    /* give it time to start up, then grab the mouse */
+    sleep_ms(500);
+    fake_key(display, trigger, true);
+    fake_key(display, trigger, false);
+    sleep_ms(100);
+
+    /* grabbed, but nothing to do */
+    double cpu_idle = cpu_ms_per_sec(pid, CPU_SAMPLE_MSEC);
+
+    /* key press to pointer motion */
+    std::vector<int64_t> latencies;
+    int missed = 0;
+    for (int i = 0; i < samples; i++) {
+        int64_t latency = measure_latency(display, right);
+        if (latency < 0) {
+            missed++;
+        } else {
+            latencies.push_back(latency);
+        }
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    /* moving all the time, the pointer ends up at the edge meanwhile */
+    fake_key(display, right, true);
+    double cpu_moving = cpu_ms_per_sec(pid, CPU_SAMPLE_MSEC);
+    fake_key(display, right, false);
+
+    stop(pid, SIGINT);
+    unlink(path);
+
+    std::cout << "{\"sleep\": " << sleep << ", \"speed\": " << speed
+              << ", \"loop\": \"" << (reactor ? "reactor" : "polling")
+              << "\", \"samples\": " << latencies.size()
+              << ", \"missed\": " << missed
+              << ", \"latency_us\": {\"p50\": " << percentile(latencies, 50)
+              << ", \"p90\": " << percentile(latencies, 90)
+              << ", \"p99\": " << percentile(latencies, 99)
+              << ", \"max\": " << percentile(latencies, 100)
+              << "}, \"cpu_idle_ms_per_s\": " << cpu_idle
+              << ", \"cpu_moving_ms_per_s\": " << cpu_moving << "}"
+              << std::endl;
+    return true;
+}
+
+/**
+ * Main function
+ */
+int
+main (int argc, char *argv[])
+{
+    std::string display_name = ":99";
+    std::string keymouse = "bin/keymouse";
+    int samples = 50;
+
+    /* process command line arguments */
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (("-d" == arg) && (i + 1 < argc)) {
+            display_name = argv[++i];
+        } else if (("-n" == arg) && (i + 1 < argc)) {
+            samples = atoi(argv[++i]);
+        } else {
+            keymouse = arg;
+        }
+    }
+
+    /* private X server, it goes away with us */
+    std::vector<std::string> args;
+    args.push_back("Xvfb");
+    args.push_back(display_name);
+    args.push_back("-screen");
+    args.push_back("0");
+    args.push_back("1920x1080x24");
+    args.push_back("-nolisten");
+    args.push_back("tcp");
+    pid_t xvfb = spawn(args, NULL);
+
+    Display *display = NULL;
+    for (int i = 0; (i < 100) && !display; i++) {
+        sleep_ms(50);
+        display = XOpenDisplay(display_name.c_str());
+    }
+    if (!display) {
+        std::cerr << "cannot start Xvfb on " << display_name << std::endl;
+        stop(xvfb, SIGTERM);
+        return 1;
+    }
+
+    int event, error, major, minor;
+    if (!XTestQueryExtension(display, &event, &error, &major, &minor)) {
+        std::cerr << "no XTest extension on " << display_name << std::endl;
+        XCloseDisplay(display);
+        stop(xvfb, SIGTERM);
+        return 1;
+    }
+
+    int rc = 0;
+    for (size_t i = 0; i < sizeof(sleeps) / sizeof(sleeps[0]); i++) {
+        for (size_t j = 0; j < sizeof(speeds) / sizeof(speeds[0]); j++) {
+            for (int reactor = 0; reactor < 2; reactor++) {
+                std::cerr << "sleep " << sleeps[i] << ", speed " << speeds[j]
+                          << ", " << (reactor ? "reactor" : "polling")
+                          << std::endl;
+                if (!run(display, display_name.c_str(), keymouse, sleeps[i],
+                         speeds[j], reactor, samples)) {
+                    rc = 1;
+                }
+            }
+        }
+    }
+
+    XCloseDisplay(display);
+    stop(xvfb, SIGTERM);
+    return rc;
+}
@@ -0,0 +1,110 @@
+/*
+ *------------------------------------------------------------------------------
+ *
+ * backend.h
+ *
+ * X request backend of project keymouse
+ *
+ * Copyright (c) 2017 Zoltan Toth <ztoth AT thetothfamily DOT net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *------------------------------------------------------------------------------
+ */
+#ifndef BACKEND_H_
+#define BACKEND_H_
+
+#include <X11/Xlib.h>
+
+#include "io.h"
+#include "overlay.h"
+
+#ifdef USE_XCB
+#include <xcb/xcb.h>
+#endif
+
+/**
+ * Backend class
+ *
+ * Every request keymouse sends to the X server goes through this class. The
+ * implementation is selected at build time: backend_xlib.cc issues plain Xlib
+ * calls, while backend_xcb.cc (make BACKEND=xcb) sends unchecked or
+ * cookie-based XCB requests on the same connection and collects the replies as
+ * late as possible. Events are still read through Xlib in both cases.
+ */
+class Backend : public OutputSink {
+  public:
+    /** constructor, pass the opened display and its root window */
+    Backend (Display *display, Window root);
+
+    /** default destructor */
+    virtual ~Backend (void);
+
+    /** grab the given keys on the root window */
+    virtual void grab_keys (const KeyCode *keys, int count,
+                            unsigned int modifiers);
+
+    /** release the given keys on the root window */
+    virtual void ungrab_keys (const KeyCode *keys, int count,
+                              unsigned int modifiers);
+
+    /** get the pointer position in root window coordinates */
+    virtual void query_pointer (int &x, int &y);
+
+    /** ask for the keyboard state, the answer is read by query_keymap() */
+    void request_keymap (void);
+
+    /** get the 32-byte keyboard state bitmap */
+    void query_keymap (char *keys);
+
+    /** move the pointer to the given root window coordinates */
+    virtual void warp_pointer (int x, int y);
+
+    /** move the pointer relative to its current position */
+    virtual void move_pointer (int dx, int dy);
+
+    /** press or release a mouse button */
+    virtual void fake_button (unsigned int button, bool press);
+
+    /** turn the wheels, one button 4-7 click per notch */
+    virtual void scroll (int dx, int dy);
+
+    /** show the navigation grid over the given rectangle, or move it there */
+    virtual void show_grid (int x, int y, int width, int height);
+
+    /** hide the navigation grid */
+    virtual void hide_grid (void);
+
+    /** send the queued requests to the server */
+    virtual void flush (void);
+
+    /** name of the backend, for debug messages */
+    const char* name (void) const;
+
+    /** number of requests so far that we had to wait for a reply to */
+    virtual unsigned long round_trips (void) const;
+
+  private:
+    Display *display;                             /** X display connection */
+    Window root;                                  /** root window */
+    unsigned long replies;                        /** replies waited for */
+    Overlay overlay;                              /** navigation grid */
+#ifdef USE_XCB
+    xcb_connection_t *conn;                       /** XCB view of display */
+    xcb_query_keymap_cookie_t keymap_cookie;      /** keymap query in flight */
+    bool keymap_pending;                          /** keymap_cookie is valid */
+#endif
+};
+
+#endif /* BACKEND_H_ */
@@ -0,0 +1,239 @@
+/*
+ *------------------------------------------------------------------------------
+ *
+ * backend_xcb.cc
+ *
+ * X request backend of project keymouse, XCB implementation
+ *
+ * Copyright (c) 2017 Zoltan Toth <ztoth AT thetothfamily DOT net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *------------------------------------------------------------------------------
+ */
+#include <cstdlib>
+#include <cstring>
+#include <X11/Xlib-xcb.h>
+#include <xcb/xcb.h>
+#include <xcb/xtest.h>
+
+#include "backend.h"
+
+/**
+ * Constructor with the display and its root window
+ *
+ * The XCB connection is the one Xlib already uses, so requests sent here are
+ * ordered correctly with the events read through Xlib.
+ */
+Backend::Backend (Display *display, Window root)
+    : display(display), root(root), replies(0), overlay(display, root),
+      conn(XGetXCBConnection(display)), keymap_pending(false)
+{
+}
+
+/**
+ * Backend destructor
+ */
+Backend::~Backend (void)
+{
+    /* collect the outstanding reply, if any */
+    if (keymap_pending) {
+        xcb_discard_reply(conn, keymap_cookie.sequence);
+    }
+}
+
+/**
+ * Grab the given keys on the root window
+ *
+ * The requests are unchecked, they are only queued here and go out with the
+ * next flush, together with whatever comes after them.
+ */
+void
+Backend::grab_keys (const KeyCode *keys, int count, unsigned int modifiers)
+{
+    for (int i = 0; i < count; i++) {
+        xcb_grab_key(conn, 0, root, modifiers, keys[i], XCB_GRAB_MODE_ASYNC,
+                     XCB_GRAB_MODE_ASYNC);
+    }
+}
+
+/**
+ * Release the given keys on the root window
+ */
+void
+Backend::ungrab_keys (const KeyCode *keys, int count, unsigned int modifiers)
+{
+    for (int i = 0; i < count; i++) {
+        xcb_ungrab_key(conn, keys[i], root, modifiers);
+    }
+}
+
+/**
+ * Get the pointer position in root window coordinates
+ *
+ * The root coordinates of the pointer do not depend on the window we ask
+ * about, so the root window is queried directly. This costs a single round
+ * trip, which also carries every request queued before it.
+ */
+void
+Backend::query_pointer (int &x, int &y)
+{
+    xcb_query_pointer_cookie_t cookie = xcb_query_pointer(conn, root);
+    replies++;
+    xcb_query_pointer_reply_t *reply = xcb_query_pointer_reply(conn, cookie,
+                                                               NULL);
+    if (reply) {
+        x = reply->root_x;
+        y = reply->root_y;
+        free(reply);
+    }
+}
+
+/**
+ * Ask for the keyboard state
+ *
+ * Only the cookie is stored, the reply is collected by query_keymap(). If the
+ * request goes out with the flush at the end of a tick, the reply arrives while
+ * we sleep and the next tick does not have to wait for it.
+ */
+void
+Backend::request_keymap (void)
+{
+    if (!keymap_pending) {
+        keymap_cookie = xcb_query_keymap(conn);
+        keymap_pending = true;
+    }
+}
+
+/**
+ * Get the 32-byte keyboard state bitmap
+ */
+void
+Backend::query_keymap (char *keys)
+{
+    request_keymap();
+    keymap_pending = false;
+
+    replies++;
+    xcb_query_keymap_reply_t *reply =
+        xcb_query_keymap_reply(conn, keymap_cookie, NULL);
+    if (reply) {
+        memcpy(keys, reply->keys, sizeof(reply->keys));
+        free(reply);
+    } else {
+        memset(keys, 0, 32);
+    }
+}
+
+/**
+ * Move the pointer to the given root window coordinates
+ */
+void
+Backend::warp_pointer (int x, int y)
+{
+    xcb_warp_pointer(conn, XCB_NONE, root, 0, 0, 0, 0, x, y);
+}
+
+/**
+ * Move the pointer relative to its current position
+ */
+void
+Backend::move_pointer (int dx, int dy)
+{
+    /* detail is true for relative motion */
+    xcb_test_fake_input(conn, XCB_MOTION_NOTIFY, 1, XCB_CURRENT_TIME, XCB_NONE,
+                        dx, dy, 0);
+}
+
+/**
+ * Press or release a mouse button
+ */
+void
+Backend::fake_button (unsigned int button, bool press)
+{
+    xcb_test_fake_input(conn, press ? XCB_BUTTON_PRESS : XCB_BUTTON_RELEASE,
+                        button, XCB_CURRENT_TIME, XCB_NONE, 0, 0, 0);
+}
+
+/**
+ * Turn the wheels by whole notches
+ *
+ * The core protocol only knows wheel buttons, so every notch is a click of
+ * button 4 (up), 5 (down), 6 (left) or 7 (right). The clicks are queued, they
+ * go out with the next flush.
+ */
+void
+Backend::scroll (int dx, int dy)
+{
+    unsigned int button = (dy < 0) ? 4 : 5;
+    for (int i = std::abs(dy); i > 0; i--) {
+        fake_button(button, true);
+        fake_button(button, false);
+    }
+    button = (dx < 0) ? 6 : 7;
+    for (int i = std::abs(dx); i > 0; i--) {
+        fake_button(button, true);
+        fake_button(button, false);
+    }
+}
+
+/**
+ * Show the navigation grid over the given rectangle, or move it there
+ *
+ * The overlay speaks Xlib, and xcb_flush() does not send what Xlib has
+ * buffered, so the grid is flushed on its own. It only changes on key presses.
+ */
+void
+Backend::show_grid (int x, int y, int width, int height)
+{
+    overlay.show(x, y, width, height);
+    XFlush(display);
+}
+
+/**
+ * Hide the navigation grid
+ */
+void
+Backend::hide_grid (void)
+{
+    overlay.hide();
+    XFlush(display);
+}
+
+/**
+ * Send the queued requests to the server
+ */
+void
+Backend::flush (void)
+{
+    xcb_flush(conn);
+}
+
+/**
+ * Name of the backend
+ */
+const char*
+Backend::name (void) const
+{
+    return "xcb";
+}
+
+/**
+ * Number of requests so far that we had to wait for a reply to
+ */
+unsigned long
+Backend::round_trips (void) const
+{
+    return replies;
+}
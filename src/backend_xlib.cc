@@ -0,0 +1,195 @@
+/*
+ *------------------------------------------------------------------------------
+ *
+ * backend_xlib.cc
+ *
+ * X request backend of project keymouse, Xlib implementation
+ *
+ * Copyright (c) 2017 Zoltan Toth <ztoth AT thetothfamily DOT net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *------------------------------------------------------------------------------
+ */
+#include <cstdlib>
+#include <X11/extensions/XTest.h>
+
+#include "backend.h"
+
+/**
+ * Constructor with the display and its root window
+ */
+Backend::Backend (Display *display, Window root)
+    : display(display), root(root), replies(0), overlay(display, root)
+{
+}
+
+/**
+ * Backend destructor
+ */
+Backend::~Backend (void)
+{
+}
+
+/**
+ * Grab the given keys on the root window
+ */
+void
+Backend::grab_keys (const KeyCode *keys, int count, unsigned int modifiers)
+{
+    for (int i = 0; i < count; i++) {
+        XGrabKey(display, keys[i], modifiers, root, False, GrabModeAsync,
+                 GrabModeAsync);
+    }
+}
+
+/**
+ * Release the given keys on the root window
+ */
+void
+Backend::ungrab_keys (const KeyCode *keys, int count, unsigned int modifiers)
+{
+    for (int i = 0; i < count; i++) {
+        XUngrabKey(display, keys[i], modifiers, root);
+    }
+}
+
+/**
+ * Get the pointer position in root window coordinates
+ *
+ * The root coordinates of the pointer do not depend on the window we ask
+ * about, so the root window is queried directly.
+ */
+void
+Backend::query_pointer (int &x, int &y)
+{
+    Window tmpwin1, tmpwin2;
+    int tmp_x, tmp_y;
+    unsigned int mask;
+    replies++;
+    XQueryPointer(display, root, &tmpwin1, &tmpwin2, &x, &y, &tmp_x, &tmp_y,
+                  &mask);
+}
+
+/**
+ * Ask for the keyboard state, nothing to do here as Xlib blocks for the reply
+ */
+void
+Backend::request_keymap (void)
+{
+}
+
+/**
+ * Get the 32-byte keyboard state bitmap
+ */
+void
+Backend::query_keymap (char *keys)
+{
+    replies++;
+    XQueryKeymap(display, keys);
+}
+
+/**
+ * Move the pointer to the given root window coordinates
+ */
+void
+Backend::warp_pointer (int x, int y)
+{
+    XWarpPointer(display, None, root, 0, 0, 0, 0, x, y);
+}
+
+/**
+ * Move the pointer relative to its current position
+ */
+void
+Backend::move_pointer (int dx, int dy)
+{
+    XTestFakeRelativeMotionEvent(display, dx, dy, CurrentTime);
+}
+
+/**
+ * Press or release a mouse button
+ */
+void
+Backend::fake_button (unsigned int button, bool press)
+{
+    XTestFakeButtonEvent(display, button, press, CurrentTime);
+}
+
+/**
+ * Turn the wheels by whole notches
+ *
+ * The core protocol only knows wheel buttons, so every notch is a click of
+ * button 4 (up), 5 (down), 6 (left) or 7 (right). The clicks are queued, they
+ * go out with the next flush.
+ */
+void
+Backend::scroll (int dx, int dy)
+{
+    unsigned int button = (dy < 0) ? 4 : 5;
+    for (int i = std::abs(dy); i > 0; i--) {
+        fake_button(button, true);
+        fake_button(button, false);
+    }
+    button = (dx < 0) ? 6 : 7;
+    for (int i = std::abs(dx); i > 0; i--) {
+        fake_button(button, true);
+        fake_button(button, false);
+    }
+}
+
+/**
+ * Show the navigation grid over the given rectangle, or move it there
+ */
+void
+Backend::show_grid (int x, int y, int width, int height)
+{
+    overlay.show(x, y, width, height);
+}
+
+/**
+ * Hide the navigation grid
+ */
+void
+Backend::hide_grid (void)
+{
+    overlay.hide();
+}
+
+/**
+ * Send the queued requests to the server
+ */
+void
+Backend::flush (void)
+{
+    XFlush(display);
+}
+
+/**
+ * Name of the backend
+ */
+const char*
+Backend::name (void) const
+{
+    return "xlib";
+}
+
+/**
+ * Number of requests so far that we had to wait for a reply to
+ */
+unsigned long
+Backend::round_trips (void) const
+{
+    return replies;
+}
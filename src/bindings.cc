@@ -0,0 +1,258 @@
+/*
+ *------------------------------------------------------------------------------
+ *
+ * bindings.cc
+ *
+ * Key binding table of project keymouse
+ *
+ * Copyright (c) 2017 Zoltan Toth <ztoth AT thetothfamily DOT net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *------------------------------------------------------------------------------
+ */
+#include <cstdlib>
+
+#include "bindings.h"
+
+/** directions in the order of the moves masks */
+static const int directions[4] = { UP, DOWN, LEFT, RIGHT };
+
+/** config names of the actions */
+static const struct {
+    const char *name;
+    action_type_t type;
+    int arg;
+} action_names[] = {
+    { "up",            ACTION_MOVE,   UP },
+    { "down",          ACTION_MOVE,   DOWN },
+    { "left",          ACTION_MOVE,   LEFT },
+    { "right",         ACTION_MOVE,   RIGHT },
+    { "up_left",       ACTION_MOVE,   UP | LEFT },
+    { "up_right",      ACTION_MOVE,   UP | RIGHT },
+    { "down_left",     ACTION_MOVE,   DOWN | LEFT },
+    { "down_right",    ACTION_MOVE,   DOWN | RIGHT },
+    { "click",         ACTION_BUTTON, 1 },
+    { "middle_click",  ACTION_BUTTON, 2 },
+    { "right_click",   ACTION_BUTTON, 3 },
+    { "paste",         ACTION_TAP,    2 },
+    { "double_click",  ACTION_DOUBLE, 1 },
+    { "scroll_up",     ACTION_SCROLL, UP },
+    { "scroll_down",   ACTION_SCROLL, DOWN },
+    { "scroll_left",   ACTION_SCROLL, LEFT },
+    { "scroll_right",  ACTION_SCROLL, RIGHT },
+    { "slow",          ACTION_GEAR,   GEAR_SLOW },
+    { "fast",          ACTION_GEAR,   GEAR_FAST },
+    { "grid",          ACTION_GRID,   GRID_TOGGLE },
+    { "grid_cancel",   ACTION_GRID,   GRID_CANCEL },
+    { "snap_up",       ACTION_SNAP,   UP },
+    { "snap_down",     ACTION_SNAP,   DOWN },
+    { "snap_left",     ACTION_SNAP,   LEFT },
+    { "snap_right",    ACTION_SNAP,   RIGHT },
+    { "edge_up",       ACTION_SNAP,   UP | SNAP_EDGE },
+    { "edge_down",     ACTION_SNAP,   DOWN | SNAP_EDGE },
+    { "edge_left",     ACTION_SNAP,   LEFT | SNAP_EDGE },
+    { "edge_right",    ACTION_SNAP,   RIGHT | SNAP_EDGE }
+};
+
+/**
+ * Constructor
+ */
+Bindings::Bindings (void)
+{
+    for (int i = 0; i < 256; i++) {
+        table[i].type = ACTION_NONE;
+        table[i].arg = 0;
+    }
+    keyset_clear(bound);
+    compile();
+}
+
+/**
+ * Bindings destructor
+ */
+Bindings::~Bindings (void)
+{
+}
+
+/**
+ * Bind a key to an action
+ */
+bool
+Bindings::add (unsigned int code, action_type_t type, int arg)
+{
+    if ((0 == code) || (code > 0xff) || (ACTION_NONE != table[code].type)) {
+        return false;
+    }
+    table[code].type = type;
+    table[code].arg = arg;
+    keyset_set(bound, code, true);
+    return true;
+}
+
+/**
+ * Build the masks
+ */
+void
+Bindings::compile (void)
+{
+    for (int i = 0; i < 4; i++) {
+        keyset_clear(moves[i]);
+        keyset_clear(scrolls[i]);
+    }
+    keyset_clear(slow);
+    keyset_clear(fast);
+    keyset_clear(buttons);
+
+    for (int code = 0; code < 256; code++) {
+        const binding_t &binding = table[code];
+        switch (binding.type) {
+        case ACTION_MOVE:
+            for (int i = 0; i < 4; i++) {
+                keyset_set(moves[i], code, binding.arg & directions[i]);
+            }
+            break;
+        case ACTION_SCROLL:
+            for (int i = 0; i < 4; i++) {
+                keyset_set(scrolls[i], code, binding.arg & directions[i]);
+            }
+            break;
+        case ACTION_GEAR:
+            keyset_set(GEAR_SLOW == binding.arg ? slow : fast, code, true);
+            break;
+        case ACTION_BUTTON:
+        case ACTION_TAP:
+        case ACTION_DOUBLE:
+            keyset_set(buttons, code, true);
+            break;
+        case ACTION_GRID:
+        case ACTION_SNAP:
+        case ACTION_NONE:
+        default:
+            break;
+        }
+    }
+}
+
+/**
+ * Resolve the held keys
+ */
+void
+Bindings::resolve (const keyset_t &held, const keyset_t &prev,
+                   actions_t &actions) const
+{
+    actions.move = STOP;
+    actions.scroll = STOP;
+    for (int i = 0; i < 4; i++) {
+        if (keyset_any(held, moves[i])) {
+            actions.move |= directions[i];
+        }
+        if (keyset_any(held, scrolls[i])) {
+            actions.scroll |= directions[i];
+        }
+    }
+
+    /* slow wins if both gears are held */
+    actions.gear = GEAR_NORMAL;
+    if (keyset_any(held, slow)) {
+        actions.gear = GEAR_SLOW;
+    } else if (keyset_any(held, fast)) {
+        actions.gear = GEAR_FAST;
+    }
+
+    for (int i = 0; i < 4; i++) {
+        uint64_t changed = (held.bits[i] ^ prev.bits[i]) & buttons.bits[i];
+        actions.pressed.bits[i] = changed & held.bits[i];
+        actions.released.bits[i] = changed & prev.bits[i];
+    }
+}
+
+/**
+ * Get the binding of a key
+ */
+const binding_t&
+Bindings::lookup (unsigned int code) const
+{
+    return table[code & 0xff];
+}
+
+/**
+ * Every bound key
+ */
+const keyset_t&
+Bindings::keys (void) const
+{
+    return bound;
+}
+
+/**
+ * The keys with button-like actions
+ */
+const keyset_t&
+Bindings::button_keys (void) const
+{
+    return buttons;
+}
+
+/**
+ * True if both tables bind the same keys to the same actions
+ */
+bool
+Bindings::operator== (const Bindings &other) const
+{
+    for (int i = 0; i < 256; i++) {
+        if ((table[i].type != other.table[i].type) ||
+            (table[i].arg != other.table[i].arg)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Parse an action name from the config
+ *
+ * Besides the names in the table, "buttonN" holds down mouse button N and
+ * "double_clickN" double-clicks it.
+ */
+bool
+Bindings::parse_action (const std::string &name, action_type_t &type, int &arg)
+{
+    for (size_t i = 0;
+         i < sizeof(action_names) / sizeof(action_names[0]); i++) {
+        if (name == action_names[i].name) {
+            type = action_names[i].type;
+            arg = action_names[i].arg;
+            return true;
+        }
+    }
+
+    if ((name.compare(0, 6, "button") == 0) && (name.size() > 6)) {
+        int button = std::atoi(name.c_str() + 6);
+        if ((button > 0) && (button < 32)) {
+            type = ACTION_BUTTON;
+            arg = button;
+            return true;
+        }
+    }
+    if ((name.compare(0, 12, "double_click") == 0) && (name.size() > 12)) {
+        int button = std::atoi(name.c_str() + 12);
+        if ((button > 0) && (button < 32)) {
+            type = ACTION_DOUBLE;
+            arg = button;
+            return true;
+        }
+    }
+    return false;
+}
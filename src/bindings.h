@@ -0,0 +1,199 @@
+/*
+ *------------------------------------------------------------------------------
+ *
+ * bindings.h
+ *
+ * Key binding table of project keymouse
+ *
+ * Copyright (c) 2017 Zoltan Toth <ztoth AT thetothfamily DOT net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *------------------------------------------------------------------------------
+ */
+#ifndef BINDINGS_H_
+#define BINDINGS_H_
+
+#include <stdint.h>
+#include <string>
+
+#include "motion.h"
+
+/** mouse movement direction flags */
+typedef enum move_flag_e {
+    STOP  = 0,
+    UP    = 0x1,
+    DOWN  = 0x2,
+    LEFT  = 0x4,
+    RIGHT = 0x8
+} move_flag_t;
+
+/** actions a key can be bound to */
+typedef enum action_type_e {
+    ACTION_NONE,
+    ACTION_MOVE,                                  /** arg: direction flags */
+    ACTION_BUTTON,                                /** arg: button, held */
+    ACTION_TAP,                                   /** arg: button, on release */
+    ACTION_DOUBLE,                                /** arg: button, twice */
+    ACTION_SCROLL,                                /** arg: direction flags */
+    ACTION_GEAR,                                  /** arg: gear */
+    ACTION_GRID,                                  /** arg: grid_action_t */
+    ACTION_SNAP                                   /** arg: direction flags */
+} action_type_t;
+
+/** navigation grid actions */
+typedef enum grid_action_e {
+    GRID_TOGGLE,                                  /** show, or land if shown */
+    GRID_CANCEL                                   /** hide without landing */
+} grid_action_t;
+
+/** snap flag, jump to the next window edge instead of the next center */
+#define SNAP_EDGE 0x10
+
+/** one binding */
+typedef struct binding_s {
+    action_type_t type;
+    int arg;
+} binding_t;
+
+/** set of keycodes, one bit per key, same order as XQueryKeymap() */
+typedef struct keyset_s {
+    uint64_t bits[4];
+} keyset_t;
+
+/** empty a key set */
+static inline void
+keyset_clear (keyset_t &set)
+{
+    set.bits[0] = set.bits[1] = set.bits[2] = set.bits[3] = 0;
+}
+
+/** add or remove a key */
+static inline void
+keyset_set (keyset_t &set, unsigned int code, bool on)
+{
+    uint64_t bit = (uint64_t)1 << (code & 0x3f);
+    if (on) {
+        set.bits[(code >> 6) & 0x03] |= bit;
+    } else {
+        set.bits[(code >> 6) & 0x03] &= ~bit;
+    }
+}
+
+/** check a key */
+static inline bool
+keyset_test (const keyset_t &set, unsigned int code)
+{
+    return ((set.bits[(code >> 6) & 0x03] >> (code & 0x3f)) & 0x01);
+}
+
+/** true if the two sets have a key in common */
+static inline bool
+keyset_any (const keyset_t &a, const keyset_t &b)
+{
+    return ((a.bits[0] & b.bits[0]) | (a.bits[1] & b.bits[1]) |
+            (a.bits[2] & b.bits[2]) | (a.bits[3] & b.bits[3])) != 0;
+}
+
+/** take the lowest key out of the set, -1 if it is empty */
+static inline int
+keyset_pop (keyset_t &set)
+{
+    for (int i = 0; i < 4; i++) {
+        if (set.bits[i]) {
+            int bit = __builtin_ctzll(set.bits[i]);
+            set.bits[i] &= set.bits[i] - 1;
+            return (i << 6) | bit;
+        }
+    }
+    return -1;
+}
+
+/** load the 32-byte bitmap returned by XQueryKeymap() */
+static inline void
+keyset_from_bytes (keyset_t &set, const char *bytes)
+{
+    for (int i = 0; i < 4; i++) {
+        uint64_t word = 0;
+        for (int b = 7; b >= 0; b--) {
+            word = (word << 8) | (unsigned char)bytes[i * 8 + b];
+        }
+        set.bits[i] = word;
+    }
+}
+
+/** result of resolving the held keys against the bindings */
+typedef struct actions_s {
+    int move;                                     /** held direction flags */
+    int scroll;                                   /** held scroll directions */
+    gear_t gear;                                  /** selected speed gear */
+    keyset_t pressed;                             /** button keys gone down */
+    keyset_t released;                            /** button keys gone up */
+} actions_t;
+
+/**
+ * Bindings class
+ *
+ * Data-driven key binding table. Any number of keycodes can be bound, each to
+ * one action. compile() folds the table into 256-bit masks, one per direction
+ * (of motion and of scrolling) and gear plus one for the keys with button-like
+ * actions, so resolving the held keys of a tick takes a handful of word-wide
+ * AND/XOR operations, no matter how many bindings there are. Only the button
+ * keys that actually changed are looked up one by one.
+ */
+class Bindings {
+  public:
+    /** constructor */
+    Bindings (void);
+
+    /** default destructor */
+    virtual ~Bindings (void);
+
+    /** bind a key to an action, false if the key was already bound */
+    bool add (unsigned int code, action_type_t type, int arg);
+
+    /** build the masks, call it after the last add() */
+    void compile (void);
+
+    /** resolve the held keys, prev is the held set of the previous call */
+    void resolve (const keyset_t &held, const keyset_t &prev,
+                  actions_t &actions) const;
+
+    /** get the binding of a key */
+    const binding_t& lookup (unsigned int code) const;
+
+    /** every bound key */
+    const keyset_t& keys (void) const;
+
+    /** the keys with button-like actions */
+    const keyset_t& button_keys (void) const;
+
+    /** true if both tables bind the same keys to the same actions */
+    bool operator== (const Bindings &other) const;
+
+    /** parse an action name from the config, false if it is not one */
+    static bool parse_action (const std::string &name, action_type_t &type,
+                              int &arg);
+
+  private:
+    binding_t table[256];                         /** bindings by keycode */
+    keyset_t bound;                               /** every bound key */
+    keyset_t moves[4];                            /** keys per direction */
+    keyset_t scrolls[4];                          /** scroll keys */
+    keyset_t slow;                                /** slow gear keys */
+    keyset_t fast;                                /** fast gear keys */
+    keyset_t buttons;                             /** button-like keys */
+};
+
+#endif /* BINDINGS_H_ */
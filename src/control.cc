@@ -0,0 +1,329 @@
+/*
+ *------------------------------------------------------------------------------
+ *
+ * control.cc
+ *
+ * Control socket of project keymouse
+ *
+ * Copyright (c) 2017 Zoltan Toth <ztoth AT thetothfamily DOT net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *------------------------------------------------------------------------------
+ */
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "framework.h"
+#include "control.h"
+
+/** ready descriptors taken from the epoll set at once */
+#define CONTROL_MAX_EVENTS 16
+
+/**
+ * Constructor with the path of the socket
+ */
+Control::Control (const std::string &path)
+    : path(path), listen_fd(-1), epoll_fd(-1)
+{
+}
+
+/**
+ * Control destructor
+ */
+Control::~Control (void)
+{
+    while (!clients.empty()) {
+        drop(clients.begin()->first);
+    }
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        unlink(path.c_str());
+    }
+    if (epoll_fd >= 0) {
+        close(epoll_fd);
+    }
+}
+
+/**
+ * Create the socket and start listening
+ *
+ * A socket left behind by a previous run is replaced, anything else at the
+ * path is not touched. The socket is only accessible to our own user.
+ */
+bool
+Control::open (void)
+{
+    struct sockaddr_un addr = sockaddr_un();
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        dbug(DEBUG_LEVEL_ERROR, DEBUG_TYPE_FRAMEWORK,
+             "control socket path is too long: " << path);
+        return false;
+    }
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    struct stat st;
+    if ((0 == lstat(path.c_str(), &st)) && S_ISSOCK(st.st_mode)) {
+        unlink(path.c_str());
+    }
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    mode_t mask = umask(0077);
+    bool ok = (epoll_fd >= 0) && (listen_fd >= 0) &&
+              (0 == bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)));
+    umask(mask);
+    ok = ok && (0 == listen(listen_fd, SOMAXCONN));
+    if (ok) {
+        struct epoll_event event = epoll_event();
+        event.events = EPOLLIN;
+        event.data.fd = listen_fd;
+        ok = (0 == epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event));
+    }
+
+    if (!ok) {
+        dbug(DEBUG_LEVEL_ERROR, DEBUG_TYPE_FRAMEWORK,
+             "cannot open control socket " << path << ": " << strerror(errno));
+        if (listen_fd >= 0) {
+            close(listen_fd);
+            listen_fd = -1;
+        }
+        return false;
+    }
+
+    dbug(DEBUG_LEVEL_NORMAL, DEBUG_TYPE_FRAMEWORK,
+         "listening on control socket " << path);
+    return true;
+}
+
+/**
+ * Descriptor that becomes readable when there is something to do
+ */
+int
+Control::fd (void) const
+{
+    return epoll_fd;
+}
+
+/**
+ * Accept new clients and parse what they have sent
+ *
+ * Never blocks. The requests are appended in the order they arrived from each
+ * client.
+ */
+void
+Control::receive (std::vector<control_request_t> &requests)
+{
+    struct epoll_event events[CONTROL_MAX_EVENTS];
+    int count = epoll_wait(epoll_fd, events, CONTROL_MAX_EVENTS, 0);
+    for (int i = 0; i < count; i++) {
+        int client = events[i].data.fd;
+        if (client == listen_fd) {
+            accept_clients();
+            continue;
+        }
+
+        std::map<int, std::string>::iterator it = clients.find(client);
+        if ((it != clients.end()) &&
+            !read_client(client, it->second, requests)) {
+            drop(client);
+        }
+    }
+}
+
+/**
+ * Send a line back to a client
+ *
+ * The replies are short and rare, so they are not queued: if the socket
+ * buffer of the client is full, the reply is lost.
+ */
+void
+Control::reply (int client, const std::string &line)
+{
+    if (clients.find(client) == clients.end()) {
+        return;
+    }
+    std::string data = line + "\n";
+    if (send(client, data.data(), data.size(), MSG_NOSIGNAL | MSG_DONTWAIT) <
+        (ssize_t)data.size()) {
+        dbug(DEBUG_LEVEL_WARNING, DEBUG_TYPE_FRAMEWORK,
+             "control reply dropped");
+    }
+}
+
+/**
+ * Accept every pending connection
+ */
+void
+Control::accept_clients (void)
+{
+    while (true) {
+        int client = accept4(listen_fd, NULL, NULL,
+                             SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client < 0) {
+            if ((EAGAIN != errno) && (EWOULDBLOCK != errno) &&
+                (EINTR != errno)) {
+                dbug(DEBUG_LEVEL_WARNING, DEBUG_TYPE_FRAMEWORK,
+                     "cannot accept control client: " << strerror(errno));
+            }
+            return;
+        }
+
+        struct epoll_event event = epoll_event();
+        event.events = EPOLLIN;
+        event.data.fd = client;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client, &event) < 0) {
+            close(client);
+            continue;
+        }
+        clients[client] = std::string();
+        dbug(DEBUG_LEVEL_VERBOSE, DEBUG_TYPE_FRAMEWORK,
+             "control client " << client << " connected");
+    }
+}
+
+/**
+ * Read what a client has sent
+ *
+ * One read per call, level-triggered epoll brings us back for the rest. The
+ * complete lines are parsed right out of the buffer, only a line cut in two
+ * by the read is copied aside.
+ */
+bool
+Control::read_client (int client, std::string &partial,
+                      std::vector<control_request_t> &requests)
+{
+    static char buffer[CONTROL_READ_SIZE + 1];
+    ssize_t size = read(client, buffer, CONTROL_READ_SIZE);
+    if (size < 0) {
+        return (EAGAIN == errno) || (EWOULDBLOCK == errno) || (EINTR == errno);
+    } else if (0 == size) {
+        return false;
+    }
+    buffer[size] = '\0';
+
+    char *line = buffer;
+    char *end = buffer + size;
+    while (line < end) {
+        char *newline = (char*)memchr(line, '\n', end - line);
+        if (!newline) {
+            break;
+        }
+        *newline = '\0';
+
+        control_request_t request;
+        request.client = client;
+        const char *text = line;
+        if (!partial.empty()) {
+            partial += line;
+            text = partial.c_str();
+        }
+        if (parse(text, request)) {
+            requests.push_back(request);
+        } else if (*text) {
+            reply(client, "error");
+        }
+        partial.clear();
+        line = newline + 1;
+    }
+
+    /* keep the beginning of the last line for the next read */
+    partial.append(line, end - line);
+    if (partial.size() > CONTROL_MAX_LINE) {
+        dbug(DEBUG_LEVEL_WARNING, DEBUG_TYPE_FRAMEWORK,
+             "control client " << client << " sent a line too long");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Close a client connection
+ */
+void
+Control::drop (int client)
+{
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client, NULL);
+    close(client);
+    clients.erase(client);
+    dbug(DEBUG_LEVEL_VERBOSE, DEBUG_TYPE_FRAMEWORK,
+         "control client " << client << " disconnected");
+}
+
+/**
+ * Parse a request line
+ *
+ * The letter of the request comes first, then its numbers separated by
+ * blanks; a carriage return at the end is fine.
+ */
+bool
+Control::parse (const char *line, control_request_t &request)
+{
+    char op = line[0];
+    char *next = (char*)line + (op ? 1 : 0);
+    int values[2] = { 0, 0 };
+    int count = 0;
+    while (count < 2) {
+        char *end;
+        long value = strtol(next, &end, 10);
+        if (end == next) {
+            break;
+        }
+        values[count++] = value;
+        next = end;
+    }
+    while ((' ' == *next) || ('\t' == *next) || ('\r' == *next)) {
+        next++;
+    }
+    if (*next) {
+        return false;
+    }
+
+    request.a = values[0];
+    request.b = values[1];
+    switch (op) {
+    case 'm':
+        request.op = CONTROL_MOVE;
+        return (2 == count);
+    case 'w':
+        request.op = CONTROL_WARP;
+        return (2 == count);
+    case 'c':
+        request.op = CONTROL_CLICK;
+        request.a = count ? request.a : 1;
+        return (count <= 1) && (request.a > 0) && (request.a < 32);
+    case 'p':
+        request.op = CONTROL_PRESS;
+        return (1 == count) && (request.a > 0) && (request.a < 32);
+    case 'r':
+        request.op = CONTROL_RELEASE;
+        return (1 == count) && (request.a > 0) && (request.a < 32);
+    case 'g':
+        request.op = CONTROL_GRAB;
+        return (1 == count) && ((0 == request.a) || (1 == request.a));
+    case 's':
+        request.op = CONTROL_STATS;
+        return (0 == count);
+    default:
+        return false;
+    }
+}
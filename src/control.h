@@ -0,0 +1,117 @@
+/*
+ *------------------------------------------------------------------------------
+ *
+ * control.h
+ *
+ * Control socket of project keymouse
+ *
+ * Copyright (c) 2017 Zoltan Toth <ztoth AT thetothfamily DOT net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *------------------------------------------------------------------------------
+ */
+#ifndef CONTROL_H_
+#define CONTROL_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+/** bytes read from a client at once */
+#define CONTROL_READ_SIZE 65536
+
+/** longest request line, a client sending a longer one is dropped */
+#define CONTROL_MAX_LINE 256
+
+/** requests of the control socket */
+typedef enum control_op_e {
+    CONTROL_MOVE,                                 /** a, b: offset */
+    CONTROL_WARP,                                 /** a, b: position */
+    CONTROL_CLICK,                                /** a: button */
+    CONTROL_PRESS,                                /** a: button */
+    CONTROL_RELEASE,                              /** a: button */
+    CONTROL_GRAB,                                 /** a: 1 grab, 0 release */
+    CONTROL_STATS                                 /** reply with the counters */
+} control_op_t;
+
+/** one parsed request */
+typedef struct control_request_s {
+    control_op_t op;
+    int a;
+    int b;
+    int client;                                   /** where a reply goes */
+} control_request_t;
+
+/**
+ * Control class
+ *
+ * Unix domain stream socket for driving the pointer from scripts, one request
+ * per line over a persistent connection:
+ *
+ *     m <dx> <dy>    move by an offset
+ *     w <x> <y>      warp to a position
+ *     c [<button>]   click a button, 1 by default
+ *     p <button>     press a button
+ *     r <button>     release a button
+ *     g <0|1>        release or grab the mouse
+ *     s              reply with the counters, on a single line
+ *
+ * Only the stats request and malformed lines ("error" is the reply) are
+ * answered, so a client can pipeline as many requests as it likes. The
+ * listening socket and the clients are watched by an epoll set of their own,
+ * whose descriptor the loop can wait on with everything else; receive() then
+ * takes every complete request line there is without blocking.
+ */
+class Control {
+  public:
+    /** constructor, pass the path of the socket */
+    Control (const std::string &path);
+
+    /** destructor, closes the clients and removes the socket */
+    virtual ~Control (void);
+
+    /** create the socket and start listening, false on error */
+    bool open (void);
+
+    /** descriptor that becomes readable when there is something to do */
+    int fd (void) const;
+
+    /** accept new clients and parse what they have sent */
+    void receive (std::vector<control_request_t> &requests);
+
+    /** send a line back to a client, it is dropped if the client is slow */
+    void reply (int client, const std::string &line);
+
+  private:
+    std::string path;                             /** socket path */
+    int listen_fd;                                /** listening socket */
+    int epoll_fd;                                 /** clients and listen_fd */
+    std::map<int, std::string> clients;           /** partial line per client */
+
+    /** accept every pending connection */
+    void accept_clients (void);
+
+    /** read what a client has sent, false if it is gone */
+    bool read_client (int client, std::string &partial,
+                      std::vector<control_request_t> &requests);
+
+    /** close a client connection */
+    void drop (int client);
+
+    /** parse a request line, false if it is not one */
+    static bool parse (const char *line, control_request_t &request);
+};
+
+#endif /* CONTROL_H_ */
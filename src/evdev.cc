@@ -0,0 +1,365 @@
+/*
+ *------------------------------------------------------------------------------
+ *
+ * evdev.cc
+ *
+ * Linux evdev/uinput backend of project keymouse
+ *
+ * Copyright (c) 2017 Zoltan Toth <ztoth AT thetothfamily DOT net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *------------------------------------------------------------------------------
+ */
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <linux/uinput.h>
+#include <X11/keysym.h>
+
+#include "framework.h"
+#include "evdev.h"
+
+/** keysym to kernel keycode mapping of a US keyboard, used without X */
+static const struct {
+    unsigned long keysym;
+    unsigned int code;
+} keysym_table[] = {
+    { XK_A, KEY_A }, { XK_B, KEY_B }, { XK_C, KEY_C }, { XK_D, KEY_D },
+    { XK_E, KEY_E }, { XK_F, KEY_F }, { XK_G, KEY_G }, { XK_H, KEY_H },
+    { XK_I, KEY_I }, { XK_J, KEY_J }, { XK_K, KEY_K }, { XK_L, KEY_L },
+    { XK_M, KEY_M }, { XK_N, KEY_N }, { XK_O, KEY_O }, { XK_P, KEY_P },
+    { XK_Q, KEY_Q }, { XK_R, KEY_R }, { XK_S, KEY_S }, { XK_T, KEY_T },
+    { XK_U, KEY_U }, { XK_V, KEY_V }, { XK_W, KEY_W }, { XK_X, KEY_X },
+    { XK_Y, KEY_Y }, { XK_Z, KEY_Z },
+    { XK_0, KEY_0 }, { XK_1, KEY_1 }, { XK_2, KEY_2 }, { XK_3, KEY_3 },
+    { XK_4, KEY_4 }, { XK_5, KEY_5 }, { XK_6, KEY_6 }, { XK_7, KEY_7 },
+    { XK_8, KEY_8 }, { XK_9, KEY_9 },
+    { XK_F1, KEY_F1 }, { XK_F2, KEY_F2 }, { XK_F3, KEY_F3 },
+    { XK_F4, KEY_F4 }, { XK_F5, KEY_F5 }, { XK_F6, KEY_F6 },
+    { XK_F7, KEY_F7 }, { XK_F8, KEY_F8 }, { XK_F9, KEY_F9 },
+    { XK_F10, KEY_F10 }, { XK_F11, KEY_F11 }, { XK_F12, KEY_F12 },
+    { XK_Escape, KEY_ESC }, { XK_Tab, KEY_TAB }, { XK_Return, KEY_ENTER },
+    { XK_space, KEY_SPACE }, { XK_BackSpace, KEY_BACKSPACE },
+    { XK_semicolon, KEY_SEMICOLON }, { XK_apostrophe, KEY_APOSTROPHE },
+    { XK_comma, KEY_COMMA }, { XK_period, KEY_DOT }, { XK_slash, KEY_SLASH },
+    { XK_bracketleft, KEY_LEFTBRACE }, { XK_bracketright, KEY_RIGHTBRACE },
+    { XK_Shift_L, KEY_LEFTSHIFT }, { XK_Shift_R, KEY_RIGHTSHIFT },
+    { XK_Control_L, KEY_LEFTCTRL }, { XK_Control_R, KEY_RIGHTCTRL },
+    { XK_Alt_L, KEY_LEFTALT }, { XK_Alt_R, KEY_RIGHTALT },
+    { XK_Super_L, KEY_LEFTMETA }, { XK_Super_R, KEY_RIGHTMETA },
+    { XK_Menu, KEY_COMPOSE }, { XK_Caps_Lock, KEY_CAPSLOCK },
+    { XK_Up, KEY_UP }, { XK_Down, KEY_DOWN },
+    { XK_Left, KEY_LEFT }, { XK_Right, KEY_RIGHT },
+    { XK_Home, KEY_HOME }, { XK_End, KEY_END },
+    { XK_Prior, KEY_PAGEUP }, { XK_Next, KEY_PAGEDOWN },
+    { XK_Insert, KEY_INSERT }, { XK_Delete, KEY_DELETE },
+    { XK_KP_0, KEY_KP0 }, { XK_KP_1, KEY_KP1 }, { XK_KP_2, KEY_KP2 },
+    { XK_KP_3, KEY_KP3 }, { XK_KP_4, KEY_KP4 }, { XK_KP_5, KEY_KP5 },
+    { XK_KP_6, KEY_KP6 }, { XK_KP_7, KEY_KP7 }, { XK_KP_8, KEY_KP8 },
+    { XK_KP_9, KEY_KP9 }, { XK_KP_Enter, KEY_KPENTER }
+};
+
+/**
+ * Constructor with the input device and the uinput device paths
+ */
+Evdev::Evdev (const std::string &input_path, const std::string &output_path)
+    : input_path(input_path), output_path(output_path), input_fd(-1),
+      output_fd(-1), uinput(false), at_eof(false), queued(0)
+{
+}
+
+/**
+ * Evdev destructor
+ */
+Evdev::~Evdev (void)
+{
+    flush();
+    if (output_fd >= 0) {
+        if (uinput) {
+            ioctl(output_fd, UI_DEV_DESTROY);
+        }
+        close(output_fd);
+    }
+    if (input_fd >= 0) {
+        grab(false);
+        close(input_fd);
+    }
+}
+
+/**
+ * Open both devices
+ */
+bool
+Evdev::open (void)
+{
+    input_fd = ::open(input_path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (input_fd < 0) {
+        dbug(DEBUG_LEVEL_ERROR, DEBUG_TYPE_FRAMEWORK,
+             "could not open " << input_path << ": " << strerror(errno));
+        return false;
+    }
+
+    output_fd = ::open(output_path.c_str(), O_WRONLY | O_CLOEXEC);
+    if (output_fd < 0) {
+        dbug(DEBUG_LEVEL_ERROR, DEBUG_TYPE_FRAMEWORK,
+             "could not open " << output_path << ": " << strerror(errno));
+        return false;
+    }
+
+    /* anything that is not a uinput node just gets the raw events */
+    uinput = (ioctl(output_fd, UI_SET_EVBIT, EV_KEY) == 0);
+    if (uinput && !create_device()) {
+        return false;
+    }
+
+    dbug(DEBUG_LEVEL_NORMAL, DEBUG_TYPE_FRAMEWORK,
+         "reading " << input_path << ", writing " << output_path <<
+         (uinput ? " (uinput)" : ""));
+    return true;
+}
+
+/**
+ * Set up the virtual device on the uinput node
+ */
+bool
+Evdev::create_device (void)
+{
+    /* mouse buttons */
+    ioctl(output_fd, UI_SET_KEYBIT, BTN_LEFT);
+    ioctl(output_fd, UI_SET_KEYBIT, BTN_RIGHT);
+    ioctl(output_fd, UI_SET_KEYBIT, BTN_MIDDLE);
+    ioctl(output_fd, UI_SET_KEYBIT, BTN_SIDE);
+    ioctl(output_fd, UI_SET_KEYBIT, BTN_EXTRA);
+
+    /* every keyboard key, for passing on the unbound keys */
+    for (int code = KEY_ESC; code < 248; code++) {
+        ioctl(output_fd, UI_SET_KEYBIT, code);
+    }
+
+    /* relative motion and wheels */
+    ioctl(output_fd, UI_SET_EVBIT, EV_REL);
+    ioctl(output_fd, UI_SET_RELBIT, REL_X);
+    ioctl(output_fd, UI_SET_RELBIT, REL_Y);
+    ioctl(output_fd, UI_SET_RELBIT, REL_WHEEL);
+    ioctl(output_fd, UI_SET_RELBIT, REL_HWHEEL);
+
+    struct uinput_setup setup;
+    memset(&setup, 0, sizeof(setup));
+    setup.id.bustype = BUS_VIRTUAL;
+    setup.id.vendor = 0x4b4d;
+    setup.id.product = 0x0001;
+    strncpy(setup.name, framework::project_name.c_str(),
+            UINPUT_MAX_NAME_SIZE - 1);
+
+    if ((ioctl(output_fd, UI_DEV_SETUP, &setup) < 0) ||
+        (ioctl(output_fd, UI_DEV_CREATE) < 0)) {
+        dbug(DEBUG_LEVEL_ERROR, DEBUG_TYPE_FRAMEWORK,
+             "could not create uinput device: " << strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/**
+ * File descriptor to poll for input
+ */
+int
+Evdev::fd (void) const
+{
+    return input_fd;
+}
+
+/**
+ * Read the next key transition
+ *
+ * Autorepeat (value 2) and non-key events are skipped.
+ */
+bool
+Evdev::read_key (unsigned int &code, bool &pressed, unsigned long &time)
+{
+    struct input_event event;
+    while (true) {
+        ssize_t bytes = read(input_fd, &event, sizeof(event));
+        if (0 == bytes) {
+            at_eof = true;
+            return false;
+        }
+        if (bytes != sizeof(event)) {
+            return false;
+        }
+        if ((EV_KEY != event.type) || (event.value > 1)) {
+            continue;
+        }
+
+        code = event.code + EVDEV_KEYCODE_OFFSET;
+        pressed = (1 == event.value);
+        time = event.input_event_sec * 1000 + event.input_event_usec / 1000;
+        return true;
+    }
+}
+
+/**
+ * True if the input has reached its end
+ */
+bool
+Evdev::eof (void) const
+{
+    return at_eof;
+}
+
+/**
+ * Grab or release the input device
+ */
+void
+Evdev::grab (bool on)
+{
+    if ((ioctl(input_fd, EVIOCGRAB, on ? 1 : 0) < 0) && (ENOTTY != errno)) {
+        dbug(DEBUG_LEVEL_WARNING, DEBUG_TYPE_FRAMEWORK,
+             "EVIOCGRAB failed on " << input_path << ": " << strerror(errno));
+    }
+}
+
+/**
+ * Move the pointer relative to its current position
+ */
+void
+Evdev::move_pointer (int dx, int dy)
+{
+    if (dx) {
+        emit(EV_REL, REL_X, dx);
+    }
+    if (dy) {
+        emit(EV_REL, REL_Y, dy);
+    }
+}
+
+/**
+ * Press or release a mouse button
+ *
+ * Buttons 4-7 are the wheels as in X, a press scrolls one notch and the
+ * release is ignored. Buttons 8 and 9 are the side buttons.
+ */
+void
+Evdev::fake_button (unsigned int button, bool press)
+{
+    static const unsigned short buttons[] = {
+        0, BTN_LEFT, BTN_MIDDLE, BTN_RIGHT, 0, 0, 0, 0, BTN_SIDE, BTN_EXTRA
+    };
+
+    if ((button >= 4) && (button <= 7)) {
+        if (press) {
+            emit(EV_REL, (button < 6) ? REL_WHEEL : REL_HWHEEL,
+                 (4 == button || 7 == button) ? 1 : -1);
+            emit(EV_SYN, SYN_REPORT, 0);
+        }
+    } else if ((button > 0) &&
+               (button < sizeof(buttons) / sizeof(buttons[0]))) {
+        emit(EV_KEY, buttons[button], press ? 1 : 0);
+        emit(EV_SYN, SYN_REPORT, 0);
+    }
+}
+
+/**
+ * Turn the wheels by whole notches
+ *
+ * Unlike the wheel buttons of X, a relative wheel event carries any number of
+ * notches, so a step is a single event per axis. REL_WHEEL counts up.
+ */
+void
+Evdev::scroll (int dx, int dy)
+{
+    if (dy) {
+        emit(EV_REL, REL_WHEEL, -dy);
+    }
+    if (dx) {
+        emit(EV_REL, REL_HWHEEL, dx);
+    }
+    emit(EV_SYN, SYN_REPORT, 0);
+}
+
+/**
+ * Pass a key transition on to the virtual keyboard
+ */
+void
+Evdev::forward_key (unsigned int code, bool press)
+{
+    emit(EV_KEY, code - EVDEV_KEYCODE_OFFSET, press ? 1 : 0);
+    emit(EV_SYN, SYN_REPORT, 0);
+}
+
+/**
+ * Send the queued events with a single write
+ */
+void
+Evdev::flush (void)
+{
+    if (0 == queued) {
+        return;
+    }
+
+    /* a motion report is only complete with a sync event */
+    if (EV_SYN != queue[queued - 1].type) {
+        memset(&queue[queued], 0, sizeof(queue[queued]));
+        queue[queued].type = EV_SYN;
+        queue[queued].code = SYN_REPORT;
+        queued++;
+    }
+
+    if (write(output_fd, queue, queued * sizeof(queue[0])) < 0) {
+        dbug(DEBUG_LEVEL_ERROR, DEBUG_TYPE_FRAMEWORK,
+             "could not write " << output_path << ": " << strerror(errno));
+    }
+    queued = 0;
+}
+
+/**
+ * Queue an event, flushing if the queue is full
+ */
+void
+Evdev::emit (unsigned short type, unsigned short code, int value)
+{
+    /* keep a slot free for the closing sync event */
+    if (queued >= (int)(sizeof(queue) / sizeof(queue[0])) - 1) {
+        flush();
+    }
+
+    memset(&queue[queued], 0, sizeof(queue[queued]));
+    queue[queued].type = type;
+    queue[queued].code = code;
+    queue[queued].value = value;
+    queued++;
+}
+
+/**
+ * Look up the kernel keycode of a keysym
+ */
+unsigned int
+evdev_keysym_to_keycode (unsigned long keysym)
+{
+    /* config names are case sensitive, but keys are not */
+    if ((keysym >= XK_a) && (keysym <= XK_z)) {
+        keysym = keysym - XK_a + XK_A;
+    }
+
+    for (size_t i = 0;
+         i < sizeof(keysym_table) / sizeof(keysym_table[0]); i++) {
+        if (keysym_table[i].keysym == keysym) {
+            return keysym_table[i].code + EVDEV_KEYCODE_OFFSET;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,108 @@
+/*
+ *------------------------------------------------------------------------------
+ *
+ * evdev.h
+ *
+ * Linux evdev/uinput backend of project keymouse
+ *
+ * Copyright (c) 2017 Zoltan Toth <ztoth AT thetothfamily DOT net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *------------------------------------------------------------------------------
+ */
+#ifndef EVDEV_H_
+#define EVDEV_H_
+
+#include <string>
+#include <linux/input.h>
+
+/** keycode offset between the kernel and the X server */
+#define EVDEV_KEYCODE_OFFSET 8
+
+/**
+ * Evdev class
+ *
+ * Backend that bypasses X entirely: key events are read straight from an
+ * evdev device, and pointer motion and buttons are sent through a uinput
+ * device. The keyboard is grabbed with EVIOCGRAB while the mouse is active
+ * (taken and let go while no key is held, so the system never sees half of a
+ * key press), and the keys we have no binding for are passed on through the
+ * uinput device, so the rest of the keyboard keeps working.
+ *
+ * Keycodes are exchanged in X numbering (kernel code + 8), so the same config
+ * and keymap bitmap can be used as with the X backends. Both paths are
+ * injectable: if the input is not an evdev device (e.g. a pipe or a file of
+ * struct input_event records), grabbing is skipped, and if the output is not
+ * the uinput device, the events are simply written to it.
+ */
+class Evdev {
+  public:
+    /** constructor, pass the input device and the uinput device paths */
+    Evdev (const std::string &input_path, const std::string &output_path);
+
+    /** default destructor, destroys the virtual device */
+    virtual ~Evdev (void);
+
+    /** open both devices, false on error */
+    bool open (void);
+
+    /** file descriptor to poll for input */
+    int fd (void) const;
+
+    /** read the next key transition, false if there is none pending */
+    bool read_key (unsigned int &code, bool &pressed, unsigned long &time);
+
+    /** true if the input has reached its end (only for pipes and files) */
+    bool eof (void) const;
+
+    /** grab or release the input device */
+    void grab (bool on);
+
+    /** move the pointer relative to its current position */
+    void move_pointer (int dx, int dy);
+
+    /** press or release a mouse button (X numbering) */
+    void fake_button (unsigned int button, bool press);
+
+    /** turn the wheels by whole notches, positive is down and right */
+    void scroll (int dx, int dy);
+
+    /** pass a key transition on to the virtual keyboard */
+    void forward_key (unsigned int code, bool press);
+
+    /** send the queued events with a single write */
+    void flush (void);
+
+  private:
+    std::string input_path;                       /** evdev device to read */
+    std::string output_path;                      /** uinput device to write */
+    int input_fd;                                 /** input file descriptor */
+    int output_fd;                                /** output file descriptor */
+    bool uinput;                                  /** output is a uinput one */
+    bool at_eof;                                  /** input has no more data */
+    struct input_event queue[64];                 /** events to be flushed */
+    int queued;                                   /** number of queued events */
+
+    /** set up the virtual device on the uinput node */
+    bool create_device (void);
+
+    /** queue an event, flushing if the queue is full */
+    void emit (unsigned short type, unsigned short code, int value);
+};
+
+/** look up the kernel keycode (in X numbering) of a keysym, 0 if unknown */
+unsigned int evdev_keysym_to_keycode (unsigned long keysym);
+
+#endif /* EVDEV_H_ */
@@ -22,12 +22,18 @@
  *
  *------------------------------------------------------------------------------
  */
-#include <fstream>
 #include <sstream>
-#include <iterator>
-#include <ios>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
 #include <unistd.h>
+#include <fcntl.h>
 #include <pwd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "framework.h"
 
@@ -47,73 +53,977 @@ bool log_to_syslog = false;
 
 
 /**
- * Constructor with the section name to be parsed
+ * Get the monotonic clock in nanoseconds
  */
-Config::Config (const char *section)
+uint64_t
+monotonic_ns (void)
 {
-    std::ifstream file;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
 
-    /* attempt to open config file */
-    file.open(config_file.c_str());
-    if (file.std::ios::fail()) {
-        dbug(DEBUG_LEVEL_ERROR, DEBUG_TYPE_FRAMEWORK,
-             "could not open file " << config_file << " to look for section " <<
-             section);
-        throw RC_CONFIG_FILE_NOT_FOUND;
+/** number of records in the log ring, must be a power of two */
+#define LOG_RING_SIZE 1024
+
+/** how long the logger thread sleeps when the ring is empty */
+#define LOG_DRAIN_INTERVAL_NS 10000000
+
+/** position of a record that is written out by its own thread */
+#define LOG_POSITION_SYNC ((size_t)-1)
+
+/** a slot of the log ring, the sequence tells who owns the record */
+typedef struct log_slot {
+    std::atomic<size_t> sequence;
+    log_record record;
+} log_slot;
+
+/** bounded lock-free ring of log records, many writers and one reader */
+static log_slot log_ring[LOG_RING_SIZE];
+static std::atomic<size_t> log_head(0);
+static size_t log_tail = 0;
+static std::atomic<uint64_t> log_drops(0);
+static uint64_t log_drops_reported = 0;
+
+/** the error record of each thread, never queued */
+static __thread log_record log_sync_record;
+
+/** serializes the writers of the log, the logger thread and the others */
+static pthread_mutex_t log_write_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** logger thread state */
+static pthread_t log_thread;
+static std::atomic<bool> log_running(false);
+static std::atomic<bool> log_stopping(false);
+static pthread_once_t log_ring_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Set the initial sequence of every slot in the log ring
+ */
+static void
+log_ring_init (void)
+{
+    for (size_t i = 0; i < LOG_RING_SIZE; i++) {
+        log_ring[i].sequence.store(i, std::memory_order_relaxed);
     }
+}
+
+/**
+ * Log stream buffer constructor, the last byte is kept for the terminator
+ */
+log_stream::buffer::buffer (char *begin, size_t size)
+{
+    setp(begin, begin + size - 1);
+}
 
-    /* look for the given section */
-    bool found = false;
-    while (!file.std::ios::eof()) {
-        char line[512];
-        file.getline(line, 512);
+/**
+ * Number of characters in the log stream buffer
+ */
+size_t
+log_stream::buffer::length (void) const
+{
+    return (pptr() - pbase());
+}
 
-        /* skip to the given section */
-        if (std::string(line).find(section) != (size_t)(-1)) {
-            found = true;
+/**
+ * Log stream constructor
+ */
+log_stream::log_stream (log_record *record)
+    : std::ostream(NULL), buf(record->message, LOG_MESSAGE_SIZE)
+{
+    rdbuf(&buf);
+}
 
-            dbug(DEBUG_LEVEL_NORMAL, DEBUG_TYPE_FRAMEWORK,
-                 "parsing section '" << section << "' in file " << config_file);
+/**
+ * Number of characters written to the log stream
+ */
+size_t
+log_stream::length (void) const
+{
+    return buf.length();
+}
 
-            /* read the entire section at once */
-            file.getline(line, 512, '}');
-            std::istringstream iss(line);
-            std::istream_iterator<std::string> begin(iss);
-            std::istream_iterator<std::string> end;
-            std::string key;
-            int i = 0;
+/**
+ * Reserve a record in the log ring
+ *
+ * An error gets the record of its thread instead, log_commit() writes it out.
+ */
+log_record*
+log_reserve (debug_level_en level)
+{
+    if (DEBUG_LEVEL_ERROR == level) {
+        log_sync_record.position = LOG_POSITION_SYNC;
+        clock_gettime(CLOCK_REALTIME, &log_sync_record.time);
+        return (&log_sync_record);
+    }
 
-            /* iterate through the words and save the config pairs in the map */
-            for (; begin != end; begin++) {
-                std::string s = get_word(*begin);
+    pthread_once(&log_ring_once, log_ring_init);
 
-                /* ignore the delimiter */
-                if (":" == s) {
-                    continue;
+    size_t position = log_head.load(std::memory_order_relaxed);
+    for (;;) {
+        log_slot &slot = log_ring[position & (LOG_RING_SIZE - 1)];
+        size_t sequence = slot.sequence.load(std::memory_order_acquire);
+        ssize_t diff = (ssize_t)sequence - (ssize_t)position;
+        if (0 == diff) {
+            if (log_head.compare_exchange_weak(position, position + 1,
+                                               std::memory_order_relaxed)) {
+                slot.record.position = position;
+                clock_gettime(CLOCK_REALTIME, &slot.record.time);
+                return (&slot.record);
+            }
+        } else if (diff < 0) {
+            /* the logger thread is behind, never wait for it */
+            log_drops.fetch_add(1, std::memory_order_relaxed);
+            return (NULL);
+        } else {
+            position = log_head.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+
+/**
+ * Format and write out one record
+ */
+static void
+log_write (const log_record &record)
+{
+    std::stringstream strstr;
+    if (!log_to_syslog) {
+        char timestamp[32];
+        ctime_r(&record.time.tv_sec, timestamp);
+        timestamp[strlen(timestamp) - 1] = '\0';
+        strstr << timestamp << " " << project_name << " ";
+    }
+    strstr << (record.level_name + 12) << " ";
+    if (debug_level >= DEBUG_LEVEL_VERY_VERBOSE) {
+        strstr << record.pretty_function << " [" << record.file << ":"
+               << record.line << "]: ";
+    } else {
+        strstr << "{" << (record.type_name + 11) << "} " << record.function
+               << "[" << record.line << "]: ";
+    }
+    strstr << record.message;
+    if (log_to_syslog) {
+        syslog(LOG_INFO, "%s", strstr.str().c_str());
+    } else {
+        std::cout << strstr.str() << std::endl;
+    }
+}
+
+/**
+ * Write out every committed record, returns the number of records written
+ *
+ * The caller holds the write lock.
+ */
+static size_t
+log_drain_locked (void)
+{
+    pthread_once(&log_ring_once, log_ring_init);
+
+    size_t count = 0;
+    for (;;) {
+        log_slot &slot = log_ring[log_tail & (LOG_RING_SIZE - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != log_tail + 1) {
+            break;
+        }
+        log_write(slot.record);
+        slot.sequence.store(log_tail + LOG_RING_SIZE,
+                            std::memory_order_release);
+        log_tail++;
+        count++;
+    }
+
+    /* tell about the records lost since the last time */
+    uint64_t drops = log_drops.load(std::memory_order_relaxed);
+    if (drops != log_drops_reported) {
+        std::stringstream strstr;
+        strstr << "dropped " << (drops - log_drops_reported)
+               << " log messages";
+        if (log_to_syslog) {
+            syslog(LOG_WARNING, "%s", strstr.str().c_str());
+        } else {
+            std::cout << project_name << " " << strstr.str() << std::endl;
+        }
+        log_drops_reported = drops;
+    }
+    return (count);
+}
+
+/**
+ * Write out every committed record, returns the number of records written
+ */
+static size_t
+log_drain (void)
+{
+    pthread_mutex_lock(&log_write_lock);
+    size_t count = log_drain_locked();
+    pthread_mutex_unlock(&log_write_lock);
+    return (count);
+}
+
+/**
+ * Hand a reserved record over to the logger thread
+ *
+ * An error is written out right away instead, after the records committed
+ * before it.
+ */
+void
+log_commit (log_record *record, const log_stream &stream)
+{
+    record->length = stream.length();
+    record->message[record->length] = '\0';
+    if (LOG_POSITION_SYNC == record->position) {
+        pthread_mutex_lock(&log_write_lock);
+        log_drain_locked();
+        log_write(*record);
+        pthread_mutex_unlock(&log_write_lock);
+        return;
+    }
+    log_ring[record->position & (LOG_RING_SIZE - 1)].sequence.store(
+        record->position + 1, std::memory_order_release);
+}
+
+/**
+ * Write a line as it is, after the records committed before it
+ */
+void
+log_print (const std::string &line)
+{
+    pthread_mutex_lock(&log_write_lock);
+    log_drain_locked();
+    if (log_to_syslog) {
+        syslog(LOG_INFO, "%s", line.c_str());
+    } else {
+        std::cout << line << std::endl;
+    }
+    pthread_mutex_unlock(&log_write_lock);
+}
+
+/**
+ * Logger thread, drains the ring until asked to stop
+ */
+static void*
+log_thread_main (void *arg)
+{
+    pthread_setname_np(pthread_self(), "logger");
+
+    struct timespec interval = {0, LOG_DRAIN_INTERVAL_NS};
+    while (!log_stopping.load(std::memory_order_acquire)) {
+        if (0 == log_drain()) {
+            nanosleep(&interval, NULL);
+        }
+    }
+    return (NULL);
+}
+
+/**
+ * Start the logger thread
+ */
+void
+log_start (void)
+{
+    if (log_running.load()) {
+        return;
+    }
+    log_stopping.store(false);
+    if (pthread_create(&log_thread, 0, log_thread_main, NULL) == 0) {
+        log_running.store(true);
+    }
+}
+
+/**
+ * Stop the logger thread and write out whatever is left in the ring
+ */
+void
+log_stop (void)
+{
+    if (log_running.exchange(false)) {
+        log_stopping.store(true, std::memory_order_release);
+        pthread_join(log_thread, NULL);
+    }
+    log_drain();
+    std::cout.flush();
+}
+
+/**
+ * Number of records dropped because the ring was full
+ */
+uint64_t
+log_dropped (void)
+{
+    return (log_drops.load(std::memory_order_relaxed));
+}
+
+/** deepest nesting of objects and arrays in the config file */
+#define CONFIG_MAX_DEPTH 32
+
+/** a key-value pair of a config section */
+struct config_entry {
+    std::string key;
+    std::string value;
+};
+
+/** a section of the config file, the entries are sorted by keyword */
+struct config_section {
+    std::string name;
+    std::vector<config_entry> entries;
+};
+
+/** every section of the config file, and the file they were parsed from */
+struct config_document {
+    std::vector<config_section> sections;
+    std::string path;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+};
+
+/** the last parsed config file */
+static std::shared_ptr<const config_document> config_cache;
+static pthread_mutex_t config_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** the value of a missing keyword */
+static const std::string config_empty;
+
+/**
+ * Order the config entries by keyword, and find one by its keyword
+ */
+static bool
+config_entry_before (const config_entry &a, const config_entry &b)
+{
+    return (a.key < b.key);
+}
+
+static bool
+config_entry_less (const config_entry &entry, const char *keyword)
+{
+    return (strcmp(entry.key.c_str(), keyword) < 0);
+}
+
+/**
+ * Config parser class
+ *
+ * Single-pass recursive descent JSON parser over the mapped file. The values
+ * are copied out of the file only once, into the entries of the sections; the
+ * position of the first error is kept, and turned into a line and column only
+ * if there is one.
+ */
+class config_parser {
+  public:
+    /** constructor, pass the text to parse */
+    config_parser (const char *begin, const char *end)
+        : begin(begin), pos(begin), end(end), error_pos(begin),
+          error_message(NULL)
+    {
+    }
+
+    /** parse the text into the sections of the document */
+    bool parse (config_document &document);
+
+    /** line and column (both from 1) and message of the error */
+    void error (int &line, int &column, const char *&message) const;
+
+  private:
+    const char *begin;                            /** start of the text */
+    const char *pos;                              /** next character */
+    const char *end;                              /** end of the text */
+    const char *error_pos;                        /** where it went wrong */
+    const char *error_message;                    /** what went wrong */
+
+    /** note the error at the current position, always false */
+    bool fail (const char *message);
+
+    /** skip the blanks */
+    void skip_space (void);
+
+    /** take the given character, after the blanks */
+    bool expect (char c, const char *message);
+
+    /** parse the members of an object, the '{' is already taken */
+    bool parse_object (config_section *section, const std::string &prefix,
+                       int depth);
+
+    /** parse a value of a section (NULL if it is thrown away) */
+    bool parse_value (config_section *section, const std::string &key,
+                      int depth);
+
+    /** parse the elements of an array into a comma separated list */
+    bool parse_array (std::string &value);
+
+    /** parse a string, number, boolean or null as text */
+    bool parse_scalar (std::string &value);
+
+    /** parse a string, the opening quote is already taken */
+    bool parse_string (std::string &value);
+
+    /** parse a number */
+    bool parse_number (std::string &value);
+
+    /** parse true, false or null */
+    bool parse_literal (std::string &value);
+};
+
+/**
+ * Parse the text into the sections of the document
+ *
+ * The top level is an object, every member of it that is an object is a
+ * section. The other members are checked, then thrown away. A section given
+ * twice is merged, the keyword given last wins.
+ */
+bool
+config_parser::parse (config_document &document)
+{
+    if (!expect('{', "expected an object at the top level")) {
+        return false;
+    }
+    skip_space();
+    if ((pos < end) && ('}' == *pos)) {
+        pos++;
+    } else {
+        while (true) {
+            std::string key;
+            if (!expect('"', "expected a section name") ||
+                !parse_string(key) ||
+                !expect(':', "expected ':' after the section name")) {
+                return false;
+            }
+            skip_space();
+            if ((pos < end) && ('{' == *pos)) {
+                pos++;
+                config_section *section = NULL;
+                for (size_t i = 0; i < document.sections.size(); i++) {
+                    if (document.sections[i].name == key) {
+                        section = &document.sections[i];
+                    }
                 }
+                if (!section) {
+                    document.sections.push_back(config_section());
+                    section = &document.sections.back();
+                    section->name = key;
+                }
+                if (!parse_object(section, "", 1)) {
+                    return false;
+                }
+            } else if (!parse_value(NULL, key, 1)) {
+                return false;
+            }
+
+            skip_space();
+            if ((pos < end) && (',' == *pos)) {
+                pos++;
+                continue;
+            }
+            if (!expect('}', "expected ',' or '}'")) {
+                return false;
+            }
+            break;
+        }
+    }
+
+    skip_space();
+    if (pos != end) {
+        return fail("unexpected text after the top-level object");
+    }
+
+    /* sort the sections for the lookups, the last of a keyword wins */
+    for (size_t i = 0; i < document.sections.size(); i++) {
+        std::vector<config_entry> &entries = document.sections[i].entries;
+        std::stable_sort(entries.begin(), entries.end(), config_entry_before);
+        size_t kept = 0;
+        for (size_t j = 0; j < entries.size(); j++) {
+            if ((j + 1 < entries.size()) &&
+                (entries[j].key == entries[j + 1].key)) {
+                continue;
+            }
+            if (kept != j) {
+                entries[kept].key.swap(entries[j].key);
+                entries[kept].value.swap(entries[j].value);
+            }
+            kept++;
+        }
+        entries.resize(kept);
+    }
+    return true;
+}
+
+/**
+ * Line and column (both counted from 1) and message of the error
+ */
+void
+config_parser::error (int &line, int &column, const char *&message) const
+{
+    line = 1;
+    column = 1;
+    for (const char *c = begin; c < error_pos; c++) {
+        if ('\n' == *c) {
+            line++;
+            column = 1;
+        } else {
+            column++;
+        }
+    }
+    message = error_message ? error_message : "unknown error";
+}
+
+/**
+ * Note the error at the current position
+ */
+bool
+config_parser::fail (const char *message)
+{
+    if (!error_message) {
+        error_pos = pos;
+        error_message = message;
+    }
+    return false;
+}
+
+/**
+ * Skip the blanks
+ */
+void
+config_parser::skip_space (void)
+{
+    while ((pos < end) &&
+           ((' ' == *pos) || ('\t' == *pos) || ('\n' == *pos) ||
+            ('\r' == *pos))) {
+        pos++;
+    }
+}
+
+/**
+ * Take the given character, after the blanks
+ */
+bool
+config_parser::expect (char c, const char *message)
+{
+    skip_space();
+    if ((pos == end) || (c != *pos)) {
+        return fail((pos == end) ? "unexpected end of file" : message);
+    }
+    pos++;
+    return true;
+}
+
+/**
+ * Parse the members of an object, the '{' is already taken
+ *
+ * The keywords of a nested object get the given prefix.
+ */
+bool
+config_parser::parse_object (config_section *section,
+                             const std::string &prefix, int depth)
+{
+    if (depth > CONFIG_MAX_DEPTH) {
+        return fail("too deeply nested");
+    }
+    skip_space();
+    if ((pos < end) && ('}' == *pos)) {
+        pos++;
+        return true;
+    }
 
-                /* we look for string pairs for the map */
-                if (i % 2) {
-                    /* odd means we have a value for the previous key */
-                    dbug(DEBUG_LEVEL_NORMAL, DEBUG_TYPE_FRAMEWORK,
-                         "parsed " << section << " pair: " << key << " = " << s);
-                    configs[key] = s;
+    while (true) {
+        std::string key;
+        if (!expect('"', "expected a keyword") || !parse_string(key) ||
+            !expect(':', "expected ':' after the keyword")) {
+            return false;
+        }
+        if (!parse_value(section, prefix + key, depth)) {
+            return false;
+        }
+
+        skip_space();
+        if ((pos < end) && (',' == *pos)) {
+            pos++;
+            continue;
+        }
+        return expect('}', "expected ',' or '}'");
+    }
+}
+
+/**
+ * Parse a value of a section
+ *
+ * Objects are flattened into the section with the keyword as prefix, arrays
+ * become comma separated lists.
+ */
+bool
+config_parser::parse_value (config_section *section, const std::string &key,
+                            int depth)
+{
+    skip_space();
+    if (pos == end) {
+        return fail("unexpected end of file");
+    }
+
+    config_entry entry;
+    if ('{' == *pos) {
+        pos++;
+        return parse_object(section, key + ".", depth + 1);
+    } else if ('[' == *pos) {
+        pos++;
+        if (!parse_array(entry.value)) {
+            return false;
+        }
+    } else if (!parse_scalar(entry.value)) {
+        return false;
+    }
+
+    if (section) {
+        entry.key = key;
+        section->entries.push_back(entry);
+    }
+    return true;
+}
+
+/**
+ * Parse the elements of an array into a comma separated list
+ *
+ * Only strings, numbers and booleans can be listed.
+ */
+bool
+config_parser::parse_array (std::string &value)
+{
+    skip_space();
+    if ((pos < end) && (']' == *pos)) {
+        pos++;
+        return true;
+    }
+
+    while (true) {
+        skip_space();
+        if ((pos < end) && (('{' == *pos) || ('[' == *pos))) {
+            return fail("arrays can only hold strings, numbers and booleans");
+        }
+        std::string element;
+        if (!parse_scalar(element)) {
+            return false;
+        }
+        if (!value.empty()) {
+            value += ',';
+        }
+        value += element;
+
+        skip_space();
+        if ((pos < end) && (',' == *pos)) {
+            pos++;
+            continue;
+        }
+        return expect(']', "expected ',' or ']'");
+    }
+}
+
+/**
+ * Parse a string, number, boolean or null as text
+ */
+bool
+config_parser::parse_scalar (std::string &value)
+{
+    skip_space();
+    if (pos == end) {
+        return fail("unexpected end of file");
+    }
+    if ('"' == *pos) {
+        pos++;
+        return parse_string(value);
+    } else if (('-' == *pos) || ((*pos >= '0') && (*pos <= '9'))) {
+        return parse_number(value);
+    }
+    return parse_literal(value);
+}
+
+/**
+ * Parse a string, the opening quote is already taken
+ *
+ * The escapes are resolved, \\u ones into UTF-8 (surrogate pairs as well).
+ */
+bool
+config_parser::parse_string (std::string &value)
+{
+    const char *start = pos;
+    while (true) {
+        /* copy the plain run at once */
+        const char *run = pos;
+        while ((pos < end) && ('"' != *pos) && ('\\' != *pos) &&
+               ((unsigned char)*pos >= 0x20)) {
+            pos++;
+        }
+        value.append(run, pos - run);
+
+        if (pos == end) {
+            pos = start - 1;
+            return fail("unterminated string");
+        } else if ('"' == *pos) {
+            pos++;
+            return true;
+        } else if ('\\' != *pos) {
+            return fail("control character in a string");
+        }
+
+        /* an escape */
+        pos++;
+        if (pos == end) {
+            pos = start - 1;
+            return fail("unterminated string");
+        }
+        char c = *pos++;
+        switch (c) {
+        case '"':
+        case '\\':
+        case '/':
+            value += c;
+            break;
+        case 'b':
+            value += '\b';
+            break;
+        case 'f':
+            value += '\f';
+            break;
+        case 'n':
+            value += '\n';
+            break;
+        case 'r':
+            value += '\r';
+            break;
+        case 't':
+            value += '\t';
+            break;
+        case 'u': {
+            unsigned long code = 0;
+            for (int round = 0; round < 2; round++) {
+                unsigned long unit = 0;
+                for (int i = 0; i < 4; i++, pos++) {
+                    char h = (pos < end) ? *pos : '\0';
+                    unit <<= 4;
+                    if ((h >= '0') && (h <= '9')) {
+                        unit |= h - '0';
+                    } else if ((h >= 'a') && (h <= 'f')) {
+                        unit |= h - 'a' + 10;
+                    } else if ((h >= 'A') && (h <= 'F')) {
+                        unit |= h - 'A' + 10;
+                    } else {
+                        return fail("bad \\u escape");
+                    }
+                }
+                if (0 == round) {
+                    code = unit;
+                    if ((code < 0xd800) || (code > 0xdbff)) {
+                        break;
+                    }
+                    /* a high surrogate, the low one must follow */
+                    if ((end - pos < 2) || ('\\' != pos[0]) ||
+                        ('u' != pos[1])) {
+                        return fail("lone surrogate in a \\u escape");
+                    }
+                    pos += 2;
+                } else if ((unit < 0xdc00) || (unit > 0xdfff)) {
+                    return fail("lone surrogate in a \\u escape");
                 } else {
-                    /* even means we have a new key */
-                    key = s;
+                    code = 0x10000 + ((code - 0xd800) << 10) + (unit - 0xdc00);
                 }
-                i++;
             }
-
+            if ((code >= 0xdc00) && (code <= 0xdfff)) {
+                return fail("lone surrogate in a \\u escape");
+            }
+            if (code < 0x80) {
+                value += (char)code;
+            } else if (code < 0x800) {
+                value += (char)(0xc0 | (code >> 6));
+                value += (char)(0x80 | (code & 0x3f));
+            } else if (code < 0x10000) {
+                value += (char)(0xe0 | (code >> 12));
+                value += (char)(0x80 | ((code >> 6) & 0x3f));
+                value += (char)(0x80 | (code & 0x3f));
+            } else {
+                value += (char)(0xf0 | (code >> 18));
+                value += (char)(0x80 | ((code >> 12) & 0x3f));
+                value += (char)(0x80 | ((code >> 6) & 0x3f));
+                value += (char)(0x80 | (code & 0x3f));
+            }
             break;
         }
+        default:
+            pos--;
+            return fail("bad escape in a string");
+        }
+    }
+}
+
+/**
+ * Parse a number, it is kept as written
+ */
+bool
+config_parser::parse_number (std::string &value)
+{
+    const char *start = pos;
+    if ('-' == *pos) {
+        pos++;
+    }
+    if ((pos < end) && ('0' == *pos)) {
+        pos++;
+    } else if ((pos < end) && (*pos >= '1') && (*pos <= '9')) {
+        while ((pos < end) && (*pos >= '0') && (*pos <= '9')) {
+            pos++;
+        }
+    } else {
+        return fail("bad number");
+    }
+    if ((pos < end) && ('.' == *pos)) {
+        pos++;
+        if ((pos == end) || (*pos < '0') || (*pos > '9')) {
+            return fail("bad number");
+        }
+        while ((pos < end) && (*pos >= '0') && (*pos <= '9')) {
+            pos++;
+        }
+    }
+    if ((pos < end) && (('e' == *pos) || ('E' == *pos))) {
+        pos++;
+        if ((pos < end) && (('+' == *pos) || ('-' == *pos))) {
+            pos++;
+        }
+        if ((pos == end) || (*pos < '0') || (*pos > '9')) {
+            return fail("bad number");
+        }
+        while ((pos < end) && (*pos >= '0') && (*pos <= '9')) {
+            pos++;
+        }
+    }
+    value.assign(start, pos - start);
+    return true;
+}
+
+/**
+ * Parse true, false or null, null is the empty string
+ */
+bool
+config_parser::parse_literal (std::string &value)
+{
+    static const char *literals[] = { "true", "false", "null" };
+    for (int i = 0; i < 3; i++) {
+        size_t length = strlen(literals[i]);
+        if (((size_t)(end - pos) >= length) &&
+            (0 == strncmp(pos, literals[i], length))) {
+            pos += length;
+            value = (2 == i) ? "" : literals[i];
+            return true;
+        }
+    }
+    return fail("expected a value");
+}
+
+/**
+ * Get the parsed config file, parsing it only if it has changed
+ *
+ * The file is recognized by its path, inode, size and modification time, so
+ * an editor replacing it is noticed as well.
+ */
+static std::shared_ptr<const config_document>
+config_load (const std::string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if ((fd < 0) || (fstat(fd, &st) < 0)) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return std::shared_ptr<const config_document>();
     }
 
-    /* close config file */
-    file.close();
+    pthread_mutex_lock(&config_cache_lock);
+    std::shared_ptr<const config_document> cached = config_cache;
+    pthread_mutex_unlock(&config_cache_lock);
+    if (cached && (cached->path == path) && (cached->dev == st.st_dev) &&
+        (cached->ino == st.st_ino) && (cached->size == st.st_size) &&
+        (cached->mtime.tv_sec == st.st_mtim.tv_sec) &&
+        (cached->mtime.tv_nsec == st.st_mtim.tv_nsec)) {
+        close(fd);
+        return cached;
+    }
+
+    /* map the file and parse it in one go */
+    std::shared_ptr<config_document> document(new config_document());
+    document->path = path;
+    document->dev = st.st_dev;
+    document->ino = st.st_ino;
+    document->size = st.st_size;
+    document->mtime = st.st_mtim;
+
+    const char *text = "";
+    void *map = MAP_FAILED;
+    if (st.st_size > 0) {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (MAP_FAILED != map) {
+            text = (const char*)map;
+        }
+    }
+    close(fd);
+    if ((st.st_size > 0) && (MAP_FAILED == map)) {
+        dbug(DEBUG_LEVEL_ERROR, DEBUG_TYPE_FRAMEWORK,
+             "could not map file " << path << ": " << strerror(errno));
+        return std::shared_ptr<const config_document>();
+    }
+
+    config_parser parser(text, text + (MAP_FAILED == map ? 0 : st.st_size));
+    bool ok = parser.parse(*document);
+    int line, column;
+    const char *message;
+    if (!ok) {
+        parser.error(line, column, message);
+    }
+    if (MAP_FAILED != map) {
+        munmap(map, st.st_size);
+    }
+    if (!ok) {
+        dbug(DEBUG_LEVEL_ERROR, DEBUG_TYPE_FRAMEWORK,
+             path << ":" << line << ":" << column << ": " << message);
+        throw RC_CONFIG_PARSE_ERROR;
+    }
+
+    dbug(DEBUG_LEVEL_NORMAL, DEBUG_TYPE_FRAMEWORK,
+         "parsed " << document->sections.size() << " section(s) of file "
+         << path);
+    for (size_t i = 0; i < document->sections.size(); i++) {
+        const config_section &section = document->sections[i];
+        for (size_t j = 0; j < section.entries.size(); j++) {
+            dbug(DEBUG_LEVEL_VERBOSE, DEBUG_TYPE_FRAMEWORK,
+                 "parsed " << section.name << " pair: "
+                 << section.entries[j].key << " = "
+                 << section.entries[j].value);
+        }
+    }
+
+    pthread_mutex_lock(&config_cache_lock);
+    config_cache = document;
+    pthread_mutex_unlock(&config_cache_lock);
+    return document;
+}
+
+/**
+ * Constructor with the section name to be read
+ */
+Config::Config (const char *section)
+    : section(NULL)
+{
+    document = config_load(config_file);
+    if (!document) {
+        dbug(DEBUG_LEVEL_ERROR, DEBUG_TYPE_FRAMEWORK,
+             "could not open file " << config_file << " to look for section " <<
+             section);
+        throw RC_CONFIG_FILE_NOT_FOUND;
+    }
+
+    for (size_t i = 0; i < document->sections.size(); i++) {
+        if (document->sections[i].name == section) {
+            this->section = &document->sections[i];
+        }
+    }
 
     /* throw an error if the section is not found */
-    if (!found) {
+    if (!this->section) {
         dbug(DEBUG_LEVEL_ERROR, DEBUG_TYPE_FRAMEWORK,
              "could not find section " << section << " in file " << config_file);
         throw RC_CONFIG_MISSING_SECTION;
@@ -125,72 +1035,80 @@ Config::Config (const char *section)
  */
 Config::~Config (void)
 {
-    configs.clear();
 }
 
 /**
- * Get a word between quotes
+ * Get the value of a keyword, NULL if there is none
+ *
+ * A binary search in the sorted entries, nothing is allocated or inserted.
  */
-std::string
-Config::get_word (const std::string &text)
+const std::string*
+Config::find (const char *keyword) const
 {
-    std::string::size_type begin = 0;
-    std::string::size_type end   = text.size();
-
-    /* find the opening quote's position */
-    while ((begin != text.size()) && (text[begin] == '"')) {
-        ++begin;
+    std::vector<config_entry>::const_iterator it =
+        std::lower_bound(section->entries.begin(), section->entries.end(),
+                         keyword, config_entry_less);
+    if ((it == section->entries.end()) || (it->key != keyword)) {
+        return NULL;
     }
-
-    /* find the closing quote's position */
-    while ((end != 0) && (text[end - 1] != '"')) {
-        --end;
-    }
-
-    /* return the substring between the quotes */
-    return (text.substr(begin, end - 1 - begin));
+    return &it->value;
 }
 
 /**
  * Get a string value for the given keyword
  */
-std::string
-Config::get_string (const std::string &keyword)
+const std::string&
+Config::get_string (const char *keyword) const
 {
-    return configs[keyword];
+    const std::string *value = find(keyword);
+    return value ? *value : config_empty;
 }
 
 /**
  * Get a float value for the given keyword
  */
 float
-Config::get_float (const std::string &keyword)
+Config::get_float (const char *keyword) const
 {
-    return (std::atof(configs[keyword].c_str()));
+    const std::string *value = find(keyword);
+    return value ? std::strtof(value->c_str(), NULL) : 0.0f;
 }
 
 /**
  * Get an int value for the given keyword
  */
 int
-Config::get_int (const std::string &keyword)
+Config::get_int (const char *keyword) const
 {
-    return (std::atoi(configs[keyword].c_str()));
+    const std::string *value = find(keyword);
+    return value ? (int)std::strtol(value->c_str(), NULL, 10) : 0;
 }
 
 /**
  * Get a boolean value for the given keyword
  */
 bool
-Config::get_bool (const std::string &keyword)
+Config::get_bool (const char *keyword) const
 {
-    if (("yes" == configs[keyword]) ||
-        ("true" == configs[keyword]) ||
-        ("t" == configs[keyword]) ||
-        ("1" == configs[keyword])) {
-        return true;
+    const std::string *value = find(keyword);
+    if (!value) {
+        return false;
     }
-    return false;
+    return (("yes" == *value) || ("true" == *value) || ("t" == *value) ||
+            ("1" == *value));
+}
+
+/**
+ * Get every keyword of the section
+ */
+std::vector<std::string>
+Config::get_keywords (void) const
+{
+    std::vector<std::string> keywords;
+    for (size_t i = 0; i < section->entries.size(); i++) {
+        keywords.push_back(section->entries[i].key);
+    }
+    return keywords;
 }
 
 } /* namespace framework */
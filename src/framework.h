@@ -29,7 +29,10 @@
 #include <sstream>
 #include <string>
 #include <map>
+#include <memory>
+#include <vector>
 #include <ctime>
+#include <stdint.h>
 #include <syslog.h>
 
 /* global variables and macros */
@@ -40,8 +43,13 @@ typedef enum return_code {
     RC_MAIN_SIGNAL_ERROR,
     RC_MAIN_LOGFILE_ERROR,
     RC_MAIN_DISPLAY_ERROR,
+    RC_MAIN_DEVICE_ERROR,
+    RC_MAIN_TRACE_ERROR,
+    RC_MAIN_REPLAY_MISMATCH,
     RC_CONFIG_FILE_NOT_FOUND,
-    RC_CONFIG_MISSING_SECTION
+    RC_CONFIG_MISSING_SECTION,
+    RC_CONFIG_PARSE_ERROR,
+    RC_MAIN_USAGE_ERROR
 } return_code_en;
 
 /** debug types */
@@ -59,39 +67,45 @@ typedef enum debug_level {
     DEBUG_LEVEL_VERY_VERBOSE
 } debug_level_en;
 
+/** most verbose level compiled in, e.g. -DDEBUG_LEVEL_MAX=DEBUG_LEVEL_NORMAL */
+#ifndef DEBUG_LEVEL_MAX
+#define DEBUG_LEVEL_MAX DEBUG_LEVEL_VERY_VERBOSE
+#endif
+
+/** size of the message text in a log record, longer messages are cut */
+#define LOG_MESSAGE_SIZE 256
+
 /** logging is only enabled when code is compiled with DEBUG flag */
 #ifdef DEBUG
 
 /** print the name of the variable, as it appears in source code */
 #define VNAME(v) #v
 
-/** cut off the newline character from the output of ctime() */
-#define TIMESTAMP(t) (t).substr(0, (t).length() - 1)
-
-/** debug macro alias, used when code is compiled with the DEBUG flag */
+/**
+ * debug macro alias, used when code is compiled with the DEBUG flag
+ *
+ * Only the message itself is formatted in the caller's thread, into a record
+ * of the lock-free log ring. The logger thread adds the timestamp and the rest
+ * of the prefix, and does the actual writing. If the ring is full, the record
+ * is dropped and counted instead of waiting. Errors are written out before
+ * dbug returns, as they often come right before an exit that would lose them.
+ */
 #define dbug(l, t, s)                                                          \
     do {                                                                       \
-        if (((debug_level_en)(l) <= framework::debug_level) &&                 \
+        if (((debug_level_en)(l) <= DEBUG_LEVEL_MAX) &&                        \
+            ((debug_level_en)(l) <= framework::debug_level) &&                 \
             (debug_type_en)(t)) {                                              \
-            std::stringstream strstr;                                          \
-            time_t timestamp = time(NULL);                                     \
-            if (!framework::log_to_syslog) {                                   \
-                strstr << TIMESTAMP(std::string(ctime(&timestamp)))            \
-                       << " " << framework::project_name << " ";               \
-            }                                                                  \
-            strstr << std::string(VNAME(l)).substr(12) << " ";                 \
-            if (framework::debug_level >= DEBUG_LEVEL_VERY_VERBOSE) {          \
-                strstr << __PRETTY_FUNCTION__ << " [" << __FILE__ << ":"       \
-                          << __LINE__ << "]: ";                                \
-            } else {                                                           \
-                strstr << "{" << std::string(VNAME(t)).substr(11) << "} "      \
-                          << __FUNCTION__ << "[" << __LINE__ << "]: ";         \
-            }                                                                  \
-            strstr << s << std::endl;                                          \
-            if (framework::log_to_syslog) {                                    \
-                syslog(LOG_INFO, strstr.str().c_str());                        \
-            } else {                                                           \
-                std::cout << strstr.str();                                     \
+            framework::log_record *record_ = framework::log_reserve(l);        \
+            if (record_) {                                                     \
+                record_->level_name = VNAME(l);                                \
+                record_->type_name = VNAME(t);                                 \
+                record_->function = __FUNCTION__;                              \
+                record_->pretty_function = __PRETTY_FUNCTION__;                \
+                record_->file = __FILE__;                                      \
+                record_->line = __LINE__;                                      \
+                framework::log_stream stream_(record_);                        \
+                stream_ << s;                                                  \
+                framework::log_commit(record_, stream_);                       \
             }                                                                  \
         }                                                                      \
     } while (0);
@@ -114,42 +128,112 @@ extern debug_level_en debug_level;
 /** true means log to syslog */
 extern bool log_to_syslog;
 
+/** get the monotonic clock in nanoseconds */
+uint64_t monotonic_ns (void);
+
+/** one log record, the strings except the message are string literals */
+typedef struct log_record {
+    size_t position;                              /** position in the ring */
+    struct timespec time;                         /** wall clock time */
+    const char *level_name;                       /** DEBUG_LEVEL_... */
+    const char *type_name;                        /** DEBUG_TYPE_... */
+    const char *function;                         /** caller function */
+    const char *pretty_function;                  /** caller signature */
+    const char *file;                             /** caller source file */
+    int line;                                     /** caller source line */
+    size_t length;                                /** length of message */
+    char message[LOG_MESSAGE_SIZE];               /** formatted message */
+} log_record;
+
+/**
+ * Log stream class
+ *
+ * Output stream that formats straight into the message of a log record,
+ * without any allocation. Whatever does not fit is cut off.
+ */
+class log_stream : public std::ostream {
+  public:
+    /** constructor, pass the record to format into */
+    log_stream (log_record *record);
+
+    /** number of characters written so far */
+    size_t length (void) const;
+
+  private:
+    /** stream buffer over the message of the record */
+    class buffer : public std::streambuf {
+      public:
+        buffer (char *begin, size_t size);
+        size_t length (void) const;
+    } buf;
+};
+
+/** reserve a record in the log ring, NULL if the ring is full */
+log_record* log_reserve (debug_level_en level);
+
+/** hand a reserved record over to the logger thread, or write it out */
+void log_commit (log_record *record, const log_stream &stream);
+
+/** write a line as it is, after whatever is waiting in the ring */
+void log_print (const std::string &line);
+
+/** start the logger thread */
+void log_start (void);
+
+/** stop the logger thread and write out whatever is left */
+void log_stop (void);
+
+/** number of records dropped because the ring was full */
+uint64_t log_dropped (void);
+
+/** every section of a parsed config file, see framework.cc */
+struct config_document;
+
+/** one section of a parsed config file */
+struct config_section;
+
 /**
  * Config class
  *
- * This is a very basic JSON-style config file parser. It expects everything as
- * string (between quotes), which you can later reinterpret by calling the
- * corresponding conversion member function. The configs must be grouped into
- * sections (e.g. one section per module), and the key-value pairs must be
- * separated with a colon, that is surrounded with spaces. However, please note
- * that the class does not perform any syntax checking. Please refer to the
- * example config file.
+ * JSON config file reader. The file is mapped and parsed in a single pass, and
+ * every object at the top level becomes a section (e.g. one section per
+ * module); objects nested in a section are flattened into dotted keywords
+ * ("outer.inner"), and arrays into comma separated lists. Strings, numbers and
+ * booleans are all kept as text, which you can later reinterpret by calling
+ * the corresponding conversion member function. The parsed file is cached
+ * until it changes on the disk, so a Config for another section costs a
+ * stat() and a lookup. A syntax error is reported with its line and column.
+ * Please refer to the example config file.
  */
 class Config {
   public:
-    /** constructor, pass the section you want to parse */
+    /** constructor, pass the section you want to read */
     Config (const char *section);
 
     /** default destructor */
     virtual ~Config (void);
 
-    /** get a string value for the given keyword */
-    std::string get_string (const std::string &keyword);
+    /** get a string value for the given keyword, empty if there is none */
+    const std::string& get_string (const char *keyword) const;
 
     /** get a float value for the given keyword */
-    float get_float (const std::string &keyword);
+    float get_float (const char *keyword) const;
 
     /** get an int value for the given keyword */
-    int get_int (const std::string &keyword);
+    int get_int (const char *keyword) const;
 
     /** get a boolean value for the given keyword */
-    bool get_bool (const std::string &keyword);
+    bool get_bool (const char *keyword) const;
+
+    /** get every keyword of the section */
+    std::vector<std::string> get_keywords (void) const;
 
   private:
-    std::map<std::string, std::string> configs;   /** map stores key-value pairs */
+    std::shared_ptr<const config_document> document;  /** the parsed file */
+    const config_section *section;                 /** our section in it */
 
-    /** get a word between quotes */
-    std::string get_word (const std::string &text);
+    /** get the value of a keyword, NULL if there is none */
+    const std::string* find (const char *keyword) const;
 };
 
 } /* namespace framework */
@@ -0,0 +1,129 @@
+/*
+ *------------------------------------------------------------------------------
+ *
+ * io.h
+ *
+ * Input source and output sink interfaces of project keymouse
+ *
+ * Copyright (c) 2017 Zoltan Toth <ztoth AT thetothfamily DOT net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *------------------------------------------------------------------------------
+ */
+#ifndef IO_H_
+#define IO_H_
+
+#include <stdint.h>
+#include <X11/X.h>
+
+#include "bindings.h"
+
+/** input event types */
+typedef enum input_type_e {
+    INPUT_NONE,                                   /** nothing for us */
+    INPUT_KEY,                                    /** key transition */
+    INPUT_LAYOUT,                                 /** monitor layout changed */
+    INPUT_KEYMAP                                  /** mapping changed */
+} input_type_t;
+
+/** input event */
+typedef struct input_event_s {
+    input_type_t type;
+    unsigned int code;                            /** keycode, X numbering */
+    bool pressed;                                 /** key went down */
+    uint64_t time;                                /** of now(), 0 if unknown */
+} input_event_t;
+
+/**
+ * InputSource class
+ *
+ * Everything the polling loop reads: events, the keyboard state and the clock.
+ * The X server implements it in XSource, the simulator in SimInput.
+ */
+class InputSource {
+  public:
+    /** default destructor */
+    virtual ~InputSource (void) {}
+
+    /** true if an event is waiting */
+    virtual bool pending (void) = 0;
+
+    /** wait for the next event */
+    virtual void next_event (input_event_t &event) = 0;
+
+    /** ask for the keyboard state, the answer is read by query_keys() */
+    virtual void request_keys (void) = 0;
+
+    /** get the held keys */
+    virtual void query_keys (keyset_t &keys) = 0;
+
+    /** monotonic clock in nanoseconds */
+    virtual uint64_t now (void) = 0;
+
+    /** sleep until the given time of now(), in nanoseconds */
+    virtual void sleep_until (uint64_t deadline) = 0;
+
+    /** true if there will be no more input */
+    virtual bool done (void) = 0;
+};
+
+/**
+ * OutputSink class
+ *
+ * Everything the loops send: key grabs, pointer motion and buttons. The X
+ * server implements it in Backend, the simulator in SimOutput.
+ */
+class OutputSink {
+  public:
+    /** default destructor */
+    virtual ~OutputSink (void) {}
+
+    /** grab the given keys */
+    virtual void grab_keys (const KeyCode *keys, int count,
+                            unsigned int modifiers) = 0;
+
+    /** release the given keys */
+    virtual void ungrab_keys (const KeyCode *keys, int count,
+                              unsigned int modifiers) = 0;
+
+    /** get the pointer position */
+    virtual void query_pointer (int &x, int &y) = 0;
+
+    /** move the pointer to the given coordinates */
+    virtual void warp_pointer (int x, int y) = 0;
+
+    /** move the pointer relative to its current position */
+    virtual void move_pointer (int dx, int dy) = 0;
+
+    /** press or release a mouse button */
+    virtual void fake_button (unsigned int button, bool press) = 0;
+
+    /** turn the wheels by whole notches, positive is down and right */
+    virtual void scroll (int dx, int dy) = 0;
+
+    /** show the navigation grid over the given rectangle, or move it there */
+    virtual void show_grid (int x, int y, int width, int height) = 0;
+
+    /** hide the navigation grid */
+    virtual void hide_grid (void) = 0;
+
+    /** send out whatever is queued */
+    virtual void flush (void) = 0;
+
+    /** number of requests so far that we had to wait for a reply to */
+    virtual unsigned long round_trips (void) const = 0;
+};
+
+#endif /* IO_H_ */
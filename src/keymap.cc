@@ -0,0 +1,162 @@
+/*
+ *------------------------------------------------------------------------------
+ *
+ * keymap.cc
+ *
+ * Keymap cache of project keymouse
+ *
+ * Copyright (c) 2017 Zoltan Toth <ztoth AT thetothfamily DOT net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *------------------------------------------------------------------------------
+ */
+#include <algorithm>
+#include <X11/Xutil.h>
+
+#include "framework.h"
+#include "keymap.h"
+
+/**
+ * Constructor with the display
+ */
+Keymap::Keymap (Display *display)
+    : display(display), min_code(0), max_code(-1), per_code(0)
+{
+}
+
+/**
+ * Keymap destructor
+ */
+Keymap::~Keymap (void)
+{
+}
+
+/**
+ * Fetch the whole mapping
+ */
+void
+Keymap::init (void)
+{
+    XDisplayKeycodes(display, &min_code, &max_code);
+    fetch(min_code, max_code - min_code + 1);
+}
+
+/**
+ * Refresh the copy if this is a keyboard mapping change
+ *
+ * Xlib is told about the change as well, for XLookupString() and friends.
+ */
+bool
+Keymap::handle_event (XEvent &event)
+{
+    if (MappingNotify != event.type) {
+        return false;
+    }
+    XRefreshKeyboardMapping(&event.xmapping);
+    if (MappingKeyboard != event.xmapping.request) {
+        return false;
+    }
+
+    dbug(DEBUG_LEVEL_VERBOSE, DEBUG_TYPE_FRAMEWORK,
+         "keymap changed, " << event.xmapping.count << " keycode(s) from "
+         << event.xmapping.first_keycode);
+    fetch(event.xmapping.first_keycode, event.xmapping.count);
+    return true;
+}
+
+/**
+ * Keycode of a keysym
+ *
+ * Same as XKeysymToKeycode(): the lowest keycode having the keysym in its
+ * first column, then in its second one and so on. A letter is found under its
+ * other case as well, as a keymap may only list the lowercase one.
+ */
+KeyCode
+Keymap::lookup (KeySym keysym) const
+{
+    if (NoSymbol == keysym) {
+        return 0;
+    }
+
+    std::map<KeySym, KeyCode>::const_iterator it = codes.find(keysym);
+    if (it != codes.end()) {
+        return it->second;
+    }
+
+    KeySym lower, upper;
+    XConvertCase(keysym, &lower, &upper);
+    it = codes.find(keysym == lower ? upper : lower);
+    return (it != codes.end()) ? it->second : 0;
+}
+
+/**
+ * Fetch the keysyms of count keycodes starting at first
+ *
+ * If the server has changed the number of keysyms per keycode, the rest of the
+ * copy is no good either, so everything is fetched again.
+ */
+void
+Keymap::fetch (int first, int count)
+{
+    first = std::max(first, min_code);
+    count = std::min(count, max_code - first + 1);
+    if (count <= 0) {
+        return;
+    }
+
+    int keys = max_code - min_code + 1;
+    int per = 0;
+    KeySym *reply = XGetKeyboardMapping(display, first, count, &per);
+    if (!reply) {
+        dbug(DEBUG_LEVEL_WARNING, DEBUG_TYPE_FRAMEWORK,
+             "cannot get the keyboard mapping");
+        return;
+    }
+
+    if (per != per_code) {
+        if (count < keys) {
+            XFree(reply);
+            fetch(min_code, keys);
+            return;
+        }
+        per_code = per;
+        syms.assign(keys * per_code, NoSymbol);
+    }
+    std::copy(reply, reply + count * per_code,
+              syms.begin() + (first - min_code) * per_code);
+    XFree(reply);
+
+    index();
+}
+
+/**
+ * Rebuild the index from the keysyms
+ *
+ * A local walk over a few hundred keycodes, no requests.
+ */
+void
+Keymap::index (void)
+{
+    codes.clear();
+    int keys = max_code - min_code + 1;
+    for (int column = 0; column < per_code; column++) {
+        for (int i = 0; i < keys; i++) {
+            KeySym keysym = syms[i * per_code + column];
+            if ((NoSymbol != keysym) && (codes.find(keysym) == codes.end())) {
+                codes[keysym] = min_code + i;
+            }
+        }
+    }
+}
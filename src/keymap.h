@@ -0,0 +1,73 @@
+/*
+ *------------------------------------------------------------------------------
+ *
+ * keymap.h
+ *
+ * Keymap cache of project keymouse
+ *
+ * Copyright (c) 2017 Zoltan Toth <ztoth AT thetothfamily DOT net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *------------------------------------------------------------------------------
+ */
+#ifndef KEYMAP_H_
+#define KEYMAP_H_
+
+#include <map>
+#include <vector>
+#include <X11/Xlib.h>
+
+/**
+ * Keymap class
+ *
+ * Client-side copy of the keyboard mapping with a keysym to keycode index, so
+ * the keys of the config can be resolved again without asking the server.
+ * When the mapping changes (xmodmap, setxkbmap or a layout switch; Xlib turns
+ * the XKB notifications into MappingNotify too), only the keycodes named in the
+ * notification are fetched again, with a single request.
+ */
+class Keymap {
+  public:
+    /** constructor, pass the opened display */
+    Keymap (Display *display);
+
+    /** default destructor */
+    virtual ~Keymap (void);
+
+    /** fetch the whole mapping */
+    void init (void);
+
+    /** refresh the copy on a keyboard mapping change, false if not one */
+    bool handle_event (XEvent &event);
+
+    /** keycode of a keysym, 0 if no key has it */
+    KeyCode lookup (KeySym keysym) const;
+
+  private:
+    Display *display;                             /** X display connection */
+    int min_code;                                 /** lowest keycode */
+    int max_code;                                 /** highest keycode */
+    int per_code;                                 /** keysyms per keycode */
+    std::vector<KeySym> syms;                     /** per_code per keycode */
+    std::map<KeySym, KeyCode> codes;              /** the index */
+
+    /** fetch the keysyms of count keycodes starting at first */
+    void fetch (int first, int count);
+
+    /** rebuild the index from the keysyms */
+    void index (void);
+};
+
+#endif /* KEYMAP_H_ */
@@ -11,6 +11,15 @@
  *   -c <configfile>   use the given config file (default is cfg/default.cfg)
  *   -l <logfile>      redirect std::cout to the given file
  *   -s                log messages to syslog
+ *   -r <tracefile>    record the session into the given trace file
+ *   -R <tracefile>    replay a recorded trace without an X server
+ *   -S <seconds>      run the polling loop on the simulator for the given
+ *                     virtual time, and report how long it took
+ *   -P <policy>       run the loop with the fifo or rr real-time policy
+ *   -p <priority>     static priority of the real-time policy
+ *   -a <cpu>          pin the loop to the given CPU
+ *   -d <displays>     drive the given displays (separated by commas) instead
+ *                     of the one in $DISPLAY
  *
  * Copyright (c) 2017 Zoltan Toth <ztoth AT thetothfamily DOT net>
  *
@@ -33,270 +42,2277 @@
 #include <string>
 #include <fstream>
 #include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <atomic>
+#include <algorithm>
+#include <deque>
+#include <stdint.h>
+#include <climits>
 #include <pthread.h>
+#include <sched.h>
 #include <unistd.h>
+#include <poll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/epoll.h>
 #include <X11/Xlib.h>
 #include <X11/XKBlib.h>
 #include <X11/keysym.h>
-#include <X11/extensions/XTest.h>
 
 #include "framework.h"
+#include "backend.h"
+#include "xinput.h"
+#include "evdev.h"
+#include "motion.h"
+#include "monitors.h"
+#include "windows.h"
+#include "keymap.h"
+#include "bindings.h"
+#include "stats.h"
+#include "trace.h"
+#include "io.h"
+#include "xsource.h"
+#include "sim.h"
+#include "realtime.h"
+#include "control.h"
 
-/** mouse movement direction flags */
-typedef enum move_flag_e {
-    STOP  = 0,
-    UP    = 0x1,
-    DOWN  = 0x2,
-    LEFT  = 0x4,
-    RIGHT = 0x8
-} move_flag_t;
+/** a binding as the config names it, before the keymap resolves it */
+typedef struct key_binding_s {
+    KeySym keysym;
+    action_type_t type;
+    int arg;
+    std::string action;                           /** config keyword */
+} key_binding_t;
 
 /** configuration */
 typedef struct config_s {
     KeyCode trigger;
-    KeyCode up;
-    KeyCode down;
-    KeyCode left;
-    KeyCode right;
-    KeyCode click;
-    KeyCode paste;
-    KeyCode slow;
+    Bindings bindings;
+    KeySym trigger_sym;
+    std::vector<key_binding_t> keys;              /** bindings by keysym */
     int speed;
     int sleep;
+    double refresh;
     int numlock;
+    bool reactor;
+    bool xinput2;
+    std::string evdev;
+    std::string uinput;
+    motion_config_t motion;
+    motion_config_t scroll;
+    edge_mode_t edges;
+    bool relative;
+    realtime_config_t realtime;
+    std::vector<std::string> displays;
+    std::string control;
 } config_t;
 
+/** emulated mouse state */
+typedef struct mouse_state_s {
+    bool grab_active;
+    keyset_t keys;
+    int move_state;
+    int scroll_state;
+    gear_t gear;
+    int mouse_x;
+    int mouse_y;
+    Motion motion;
+    Motion scroll;
+    uint64_t press_time;
+    keyset_t clicks;
+    bool grid_active;
+    monitor_t grid;
+} mouse_state_t;
+
+/** most wheel notches sent per axis in one tick, the rest is dropped */
+#define SCROLL_MAX_NOTCHES 8
+
+/** the "refresh" config value asking for the rate of the monitors */
+#define REFRESH_AUTO -1.0
+
+/** epoll tag of the config reload eventfd in the reactor */
+#define REACTOR_RELOAD_TAG ((uint64_t)-1)
+
+/** epoll tag of the control socket in the reactor */
+#define REACTOR_CONTROL_TAG ((uint64_t)-2)
+
+/** most ready file descriptors taken from the reactor at once */
+#define REACTOR_MAX_EVENTS 16
+
+/** everything that belongs to one X display */
+typedef struct session_s {
+    std::string name;
+    Display *display;
+    Window root;
+    Backend *x;
+    RawKeys *raw;
+    Monitors *monitors;
+    Windows *windows;
+    Keymap *keymap;
+    config_t cfg;                                 /** keys of this display */
+    mouse_state_t state;
+    keyset_t pressed_keys;                        /** held, from the events */
+    int timer_fd;                                 /** movement timer */
+    uint64_t timer_period;                        /** 0 while disarmed */
+    uint64_t last_tick;
+    std::atomic<config_t*> fresh;                 /** parsed, not picked up */
+} session_t;
+
+/** freshly parsed config of the evdev loop, the sessions have their own */
+static std::atomic<config_t*> fresh_config(NULL);
+
+/** eventfd that wakes up the main loop when there is a fresh config */
+static int reload_fd = -1;
+
+/** set on SIGINT, the loops return and the main thread cleans up */
+static std::atomic<bool> quit(false);
+
+/** run-time statistics, dumped on SIGUSR1 and reset on SIGUSR2 */
+static stats_t stats;
+
+/** session recording, NULL unless it was asked for with -r */
+static TraceWriter *recorder = NULL;
+
+/** control socket, NULL unless the config names one */
+static Control *control = NULL;
+
+/**
+ * Remember when a direction key went down, for the latency statistics
+ *
+ * Only the first press counts until the pointer has actually moved.
+ */
+static void
+note_press (config_t &cfg, mouse_state_t &state, unsigned int code,
+            uint64_t when)
+{
+    if (!state.press_time && (ACTION_MOVE == cfg.bindings.lookup(code).type)) {
+        state.press_time = when;
+    }
+}
+
+/**
+ * Count the time from a button key transition to its button event
+ */
+static void
+note_click (uint64_t when)
+{
+    uint64_t now = framework::monotonic_ns();
+    if (when && (when <= now)) {
+        stats.click_latency.record((now - when) / 1000);
+    }
+}
+
+/**
+ * Collect the keys of a set into an array
+ */
+static int
+get_keys (keyset_t set, KeyCode *keys)
+{
+    int count = 0;
+    for (int code = keyset_pop(set); code >= 0; code = keyset_pop(set)) {
+        keys[count++] = code;
+    }
+    return count;
+}
+
+/**
+ * Collect the keys to grab while the mouse is active
+ */
+static int
+get_bound_keys (config_t &cfg, KeyCode *keys)
+{
+    return get_keys(cfg.bindings.keys(), keys);
+}
+
+/**
+ * Record the config
+ *
+ * The motion parameters and the bindings (by keycode) go into the trace, so a
+ * replay depends neither on the config file nor on the keymap of the server.
+ */
+static void
+record_config (config_t &cfg)
+{
+    if (!recorder) {
+        return;
+    }
+
+    KeyCode keys[256];
+    int count = get_bound_keys(cfg, keys);
+    int flags = (cfg.relative ? TRACE_FLAG_RELATIVE : 0) |
+                (cfg.numlock ? TRACE_FLAG_NUMLOCK : 0);
+    recorder->write(0, TRACE_CONFIG, cfg.trigger, flags, cfg.edges, count);
+    recorder->write_double(TRACE_PARAM, TRACE_PARAM_SPEED, cfg.motion.speed);
+    recorder->write_double(TRACE_PARAM, TRACE_PARAM_MAX_SPEED,
+                           cfg.motion.max_speed);
+    recorder->write_double(TRACE_PARAM, TRACE_PARAM_SLOW_SPEED,
+                           cfg.motion.slow_speed);
+    recorder->write_double(TRACE_PARAM, TRACE_PARAM_ACCEL_TIME,
+                           cfg.motion.accel_time);
+    recorder->write_double(TRACE_PARAM, TRACE_PARAM_CURVE, cfg.motion.curve);
+    recorder->write_double(TRACE_PARAM, TRACE_PARAM_SCROLL_SPEED,
+                           cfg.scroll.speed);
+    recorder->write_double(TRACE_PARAM, TRACE_PARAM_SCROLL_MAX_SPEED,
+                           cfg.scroll.max_speed);
+    recorder->write_double(TRACE_PARAM, TRACE_PARAM_SCROLL_SLOW_SPEED,
+                           cfg.scroll.slow_speed);
+    recorder->write_double(TRACE_PARAM, TRACE_PARAM_SCROLL_CURVE,
+                           cfg.scroll.curve);
+    for (int i = 0; i < count; i++) {
+        const binding_t &binding = cfg.bindings.lookup(keys[i]);
+        recorder->write(0, TRACE_BIND, keys[i], binding.type, binding.arg);
+    }
+}
+
+/**
+ * Record the monitor layout
+ */
+static void
+record_layout (const Monitors &monitors)
+{
+    if (!recorder) {
+        return;
+    }
+
+    const std::vector<monitor_t> &layout = monitors.layout();
+    for (size_t i = 0; i < layout.size(); i++) {
+        const monitor_t &m = layout[i];
+        recorder->write(0, TRACE_LAYOUT, i, layout.size(), m.x, m.y, m.width,
+                        m.height);
+    }
+}
+
+/**
+ * Grab or release the mouse, depending on its current state
+ *
+ * With raw XInput2 events (raw is not NULL) the whole keyboard is grabbed
+ * instead of the bound keys one by one.
+ */
+static void
+toggle_grab (OutputSink &output, RawKeys *raw, config_t &cfg,
+             mouse_state_t &state)
+{
+    KeyCode keys[256];
+    int count = get_bound_keys(cfg, keys);
+
+    if (state.grab_active) {
+        /* release the mouse */
+        if (state.grid_active) {
+            output.hide_grid();
+            state.grid_active = false;
+        }
+        if (raw) {
+            raw->ungrab_keyboard();
+        } else {
+            output.ungrab_keys(keys, count, cfg.numlock);
+        }
+
+        dbug(DEBUG_LEVEL_NORMAL, DEBUG_TYPE_FRAMEWORK,
+             "mouse released");
+    } else {
+        /* grab the mouse */
+        if (raw) {
+            if (!raw->grab_keyboard()) {
+                return;
+            }
+        } else {
+            output.grab_keys(keys, count, cfg.numlock);
+        }
+
+        /* update mouse coordinates, unless we only ever move relative */
+        if (!cfg.relative) {
+            output.query_pointer(state.mouse_x, state.mouse_y);
+        }
+
+        dbug(DEBUG_LEVEL_NORMAL, DEBUG_TYPE_FRAMEWORK,
+             "mouse grabbed");
+    }
+    state.grab_active = !state.grab_active;
+
+    if (recorder) {
+        recorder->write(framework::monotonic_ns(), TRACE_GRAB, 0,
+                        state.grab_active, state.mouse_x, state.mouse_y);
+        if (!state.grab_active) {
+            recorder->flush();
+        }
+    }
+}
+
+/**
+ * Press or release a mouse button through the given output
+ */
+template <typename Output>
+static void
+emit_button (Output &x, unsigned int button, bool press)
+{
+    x.fake_button(button, press);
+    stats.buttons++;
+    if (recorder) {
+        recorder->write(0, TRACE_BUTTON, button, press);
+    }
+}
+
+/**
+ * Update direction flags and send button events based on the pressed keys
+ *
+ * The output is either the X Backend or the Evdev backend, anything with a
+ * fake_button() member does. Scroll keys only set the scroll directions, the
+ * wheels are turned by the ticks while they are held.
+ */
+template <typename Output>
+static void
+update_keys (Output &x, config_t &cfg, const keyset_t &pressed_keys,
+             mouse_state_t &state)
+{
+    actions_t actions;
+    cfg.bindings.resolve(pressed_keys, state.keys, actions);
+    state.keys = pressed_keys;
+
+    /* update direction flags and speed gear, the grid takes the directions */
+    state.move_state = state.grid_active ? (int)STOP : actions.move;
+    state.scroll_state = actions.scroll;
+    state.gear = actions.gear;
+
+    /* the next movement starts from the initial velocity again */
+    if (STOP == state.move_state) {
+        state.motion.stop();
+        state.press_time = 0;
+    }
+    if (STOP == state.scroll_state) {
+        state.scroll.stop();
+    }
+
+    /* send the button events of the keys that went down */
+    for (int code = keyset_pop(actions.pressed); code >= 0;
+         code = keyset_pop(actions.pressed)) {
+        const binding_t &binding = cfg.bindings.lookup(code);
+        if (ACTION_BUTTON == binding.type) {
+            emit_button(x, binding.arg, true);
+        } else if (ACTION_DOUBLE == binding.type) {
+            /* two clicks right after each other, on keypress */
+            for (int i = 0; i < 2; i++) {
+                emit_button(x, binding.arg, true);
+                emit_button(x, binding.arg, false);
+            }
+        }
+    }
+
+    /* send the button events of the keys that went up */
+    for (int code = keyset_pop(actions.released); code >= 0;
+         code = keyset_pop(actions.released)) {
+        const binding_t &binding = cfg.bindings.lookup(code);
+        if (ACTION_BUTTON == binding.type) {
+            emit_button(x, binding.arg, false);
+        } else if (ACTION_TAP == binding.type) {
+            /* button down-up event only on keyrelease */
+            emit_button(x, binding.arg, true);
+            emit_button(x, binding.arg, false);
+        }
+    }
+}
+
+/**
+ * True while the mouse is moving or scrolling, i.e. while it needs ticks
+ */
+static bool
+in_motion (const mouse_state_t &state)
+{
+    return (STOP != state.move_state) || (STOP != state.scroll_state);
+}
+
+/**
+ * Get the signs of the axes from direction flags
+ */
+static void
+get_direction (int flags, int &dir_x, int &dir_y)
+{
+    /* up or down */
+    dir_y = 0;
+    if (UP & flags) {
+        dir_y = -1;
+    } else if (DOWN & flags) {
+        dir_y = 1;
+    }
+
+    /* left or right */
+    dir_x = 0;
+    if (LEFT & flags) {
+        dir_x = -1;
+    } else if (RIGHT & flags) {
+        dir_x = 1;
+    }
+}
+
+/**
+ * Get the size of one step in the current direction(s)
+ *
+ * The step covers the time since the previous one (now is in nanoseconds), so
+ * it does not matter how regularly we are called.
+ */
+static void
+get_step (mouse_state_t &state, uint64_t now, int &dx, int &dy)
+{
+    int dir_x, dir_y;
+    get_direction(state.move_state, dir_x, dir_y);
+    state.motion.step(dir_x, dir_y, state.gear, now, dx, dy);
+}
+
+/**
+ * Turn the wheels in the current scroll direction(s)
+ *
+ * The scroll velocity (in notches per second) is integrated the same way as
+ * the pointer motion, so holding a scroll key accelerates, and whatever the
+ * tick covers goes out in one batch: at most one scroll() call per tick, with
+ * at most SCROLL_MAX_NOTCHES notches per axis. The first step of a scroll is
+ * a single notch, a tap turns the wheel as it always did.
+ */
+template <typename Output>
+static void
+scroll_wheel (Output &output, mouse_state_t &state, uint64_t now)
+{
+    if (STOP == state.scroll_state) {
+        return;
+    }
+
+    int dir_x, dir_y, dx, dy;
+    get_direction(state.scroll_state, dir_x, dir_y);
+    state.scroll.step(dir_x, dir_y, state.gear, now, dx, dy);
+    dx = std::max(-SCROLL_MAX_NOTCHES, std::min(dx, SCROLL_MAX_NOTCHES));
+    dy = std::max(-SCROLL_MAX_NOTCHES, std::min(dy, SCROLL_MAX_NOTCHES));
+    if (!dx && !dy) {
+        return;
+    }
+
+    output.scroll(dx, dy);
+    stats.notches += std::abs(dx) + std::abs(dy);
+    if (recorder) {
+        recorder->write(0, TRACE_SCROLL, 0, 0, dx, dy);
+    }
+}
+
+/**
+ * Move the mouse one step in the current direction(s), and scroll
+ *
+ * The output is the X Backend, or the collector of a replay.
+ */
+template <typename Output>
+static void
+move_mouse (Output &output, const Monitors &monitors, config_t &cfg,
+            mouse_state_t &state, uint64_t now)
+{
+    scroll_wheel(output, state, now);
+
+    int dx, dy;
+    get_step(state, now, dx, dy);
+
+    /* time from the key press to the first motion it caused */
+    if (state.press_time && (dx || dy)) {
+        stats.key_latency.record((now - state.press_time) / 1000);
+        state.press_time = 0;
+    }
+
+    /* the server keeps the pointer on the screen in relative mode */
+    if (cfg.relative) {
+        if (dx || dy) {
+            output.move_pointer(dx, dy);
+            stats.warps++;
+            if (recorder) {
+                recorder->write(0, TRACE_MOVE, 0, 0, dx, dy);
+            }
+        }
+        return;
+    }
+
+    /* keep the mouse on the monitors */
+    int x = state.mouse_x + dx;
+    int y = state.mouse_y + dy;
+    monitors.limit(state.mouse_x, state.mouse_y, x, y, cfg.edges);
+    state.mouse_x = x;
+    state.mouse_y = y;
+
+    /* put the mouse in its new position */
+    output.warp_pointer(state.mouse_x, state.mouse_y);
+    stats.warps++;
+    if (recorder) {
+        recorder->write(0, TRACE_WARP, 0, 0, state.mouse_x, state.mouse_y);
+    }
+}
+
+/**
+ * Cut the grid in half, keeping the half (or quarter) in the given direction
+ */
+static void
+cut_grid (monitor_t &grid, int flags)
+{
+    if (UP & flags) {
+        grid.height = std::max(grid.height / 2, 1);
+    } else if (DOWN & flags) {
+        grid.y += grid.height / 2;
+        grid.height -= grid.height / 2;
+    }
+    if (LEFT & flags) {
+        grid.width = std::max(grid.width / 2, 1);
+    } else if (RIGHT & flags) {
+        grid.x += grid.width / 2;
+        grid.width -= grid.width / 2;
+    }
+}
+
+/**
+ * Get the keys that went down since the previous update
+ */
+static void
+get_keys_down (const keyset_t &pressed_keys, const mouse_state_t &state,
+               keyset_t &down)
+{
+    for (int i = 0; i < 4; i++) {
+        down.bits[i] = pressed_keys.bits[i] & ~state.keys.bits[i];
+    }
+}
+
+/**
+ * Put the pointer at a point with a single warp
+ */
+template <typename Output>
+static void
+jump_pointer (Output &output, mouse_state_t &state, int x, int y)
+{
+    state.mouse_x = x;
+    state.mouse_y = y;
+    output.warp_pointer(state.mouse_x, state.mouse_y);
+    stats.warps++;
+    if (recorder) {
+        recorder->write(0, TRACE_WARP, 0, 0, state.mouse_x, state.mouse_y);
+    }
+}
+
+/**
+ * Hide the grid and land the pointer in its middle
+ */
+template <typename Output>
+static void
+land_grid (Output &output, mouse_state_t &state)
+{
+    state.grid_active = false;
+    output.hide_grid();
+    jump_pointer(output, state, state.grid.x + state.grid.width / 2,
+                 state.grid.y + state.grid.height / 2);
+}
+
+/**
+ * Drive the navigation grid with the keys that went down
+ *
+ * The grid key shows the grid over the monitor of the pointer, or lands the
+ * pointer in the middle of the grid if it is shown already. Meanwhile the
+ * direction keys cut the grid in half instead of moving the mouse, so every
+ * pixel is a dozen keystrokes away at most, and a button key lands the pointer
+ * before it clicks. Called with the same keys right before update_keys(). The
+ * grid needs absolute coordinates, it does nothing in relative mode.
+ */
+template <typename Output>
+static void
+update_grid (Output &output, const Monitors &monitors, config_t &cfg,
+             const keyset_t &pressed_keys, mouse_state_t &state)
+{
+    if (cfg.relative) {
+        return;
+    }
+
+    keyset_t down;
+    get_keys_down(pressed_keys, state, down);
+    for (int code = keyset_pop(down); code >= 0; code = keyset_pop(down)) {
+        const binding_t &binding = cfg.bindings.lookup(code);
+        if (ACTION_GRID == binding.type) {
+            if (GRID_CANCEL == binding.arg) {
+                if (state.grid_active) {
+                    output.hide_grid();
+                    state.grid_active = false;
+                }
+                continue;
+            } else if (state.grid_active) {
+                land_grid(output, state);
+                continue;
+            }
+            state.grid = monitors.at(state.mouse_x, state.mouse_y);
+            state.grid_active = true;
+        } else if (!state.grid_active) {
+            continue;
+        } else if (ACTION_MOVE == binding.type) {
+            cut_grid(state.grid, binding.arg);
+        } else if ((ACTION_BUTTON == binding.type) ||
+                   (ACTION_TAP == binding.type)) {
+            land_grid(output, state);
+            continue;
+        } else {
+            continue;
+        }
+        output.show_grid(state.grid.x, state.grid.y, state.grid.width,
+                         state.grid.height);
+    }
+}
+
+/**
+ * Jump the pointer to the next window for the snap keys that went down
+ *
+ * The target is looked up in the window index, there is no request to the
+ * server but the warp. An edge snap with no window edge left in its direction
+ * stops at the edge of the monitor. A snap hides the grid. Like the grid, it
+ * needs absolute coordinates.
+ */
+template <typename Output>
+static void
+update_snap (Output &output, const Monitors &monitors, const Windows &windows,
+             config_t &cfg, const keyset_t &pressed_keys, mouse_state_t &state)
+{
+    if (cfg.relative) {
+        return;
+    }
+
+    keyset_t down;
+    get_keys_down(pressed_keys, state, down);
+    for (int code = keyset_pop(down); code >= 0; code = keyset_pop(down)) {
+        const binding_t &binding = cfg.bindings.lookup(code);
+        if (ACTION_SNAP != binding.type) {
+            continue;
+        }
+
+        int dir_x, dir_y;
+        get_direction(binding.arg, dir_x, dir_y);
+        int x = state.mouse_x;
+        int y = state.mouse_y;
+        if (!(SNAP_EDGE & binding.arg)) {
+            windows.snap_center(x, y, dir_x, dir_y);
+        } else if (!windows.snap_edge(x, y, dir_x, dir_y)) {
+            const monitor_t &m = monitors.at(x, y);
+            if (dir_x) {
+                x = (dir_x < 0) ? m.x : m.x + m.width - 1;
+            }
+            if (dir_y) {
+                y = (dir_y < 0) ? m.y : m.y + m.height - 1;
+            }
+        }
+        if ((x == state.mouse_x) && (y == state.mouse_y)) {
+            continue;
+        }
+
+        if (state.grid_active) {
+            output.hide_grid();
+            state.grid_active = false;
+        }
+        jump_pointer(output, state, x, y);
+    }
+}
+
+/**
+ * Get the tick period in nanoseconds
+ *
+ * With "refresh" set the mouse moves once per displayed frame, at the given
+ * rate or at the rate of the fastest monitor; otherwise every "sleep" usec.
+ * The monitors are NULL if there is no X server to ask.
+ */
+static uint64_t
+tick_period (const config_t &cfg, const Monitors *monitors)
+{
+    double hz = cfg.refresh;
+    if ((REFRESH_AUTO == hz) && monitors) {
+        hz = monitors->refresh_rate();
+    }
+    if (hz > 0.0) {
+        return (uint64_t)(1e9 / hz);
+    }
+    return (uint64_t)cfg.sleep * 1000;
+}
+
+/**
+ * Count the tick deadlines that went by unnoticed
+ */
+static void
+note_overrun (uint64_t missed)
+{
+    stats.overruns += missed;
+    dbug(DEBUG_LEVEL_VERBOSE, DEBUG_TYPE_FRAMEWORK,
+         "tick overrun, " << missed << " frame(s) missed");
+}
+
+/**
+ * Pick up the freshly parsed config from the slot, NULL if there is none
+ *
+ * Whoever swaps the pointer out owns the config, so this never blocks.
+ */
+static config_t*
+take_config (std::atomic<config_t*> &slot)
+{
+    if (reload_fd >= 0) {
+        uint64_t count;
+        if (read(reload_fd, &count, sizeof(count)) < 0) {
+            /* nothing to drain */
+        }
+    }
+    return slot.exchange(NULL);
+}
+
+/**
+ * Grab the keys of a fresh config instead of the current ones
+ *
+ * Only the keys that are bound in one of the two configs but not in the other
+ * are grabbed or released, unless numlock has changed (every grab depends on
+ * it). The buttons held through the current bindings are let go. Returns true
+ * if the bindings have changed.
+ */
+static bool
+rebind_keys (OutputSink &output, RawKeys *raw, config_t &cfg,
+             mouse_state_t &state, const config_t &fresh)
+{
+    bool all = (fresh.numlock != cfg.numlock);
+    bool rebind = all || !(fresh.bindings == cfg.bindings);
+
+    if (rebind) {
+        /* let go of the buttons held through the old bindings */
+        keyset_t released;
+        keyset_clear(released);
+        update_keys(output, cfg, released, state);
+    }
+
+    /* the trigger comes last, a released key may have had its keycode */
+    keyset_t gone = cfg.bindings.keys();
+    keyset_t added = fresh.bindings.keys();
+    if (rebind && state.grab_active && !raw) {
+        for (int i = 0; (i < 4) && !all; i++) {
+            uint64_t common = gone.bits[i] & added.bits[i];
+            gone.bits[i] &= ~common;
+            added.bits[i] &= ~common;
+        }
+        KeyCode keys[256];
+        int count = get_keys(gone, keys);
+        output.ungrab_keys(keys, count, cfg.numlock);
+        count = get_keys(added, keys);
+        output.grab_keys(keys, count, fresh.numlock);
+    } else {
+        keyset_clear(gone);
+    }
+
+    /* the trigger is grabbed all the time */
+    if (all || (fresh.trigger != cfg.trigger) ||
+        keyset_test(gone, cfg.trigger)) {
+        output.ungrab_keys(&cfg.trigger, 1, cfg.numlock);
+        output.grab_keys(&fresh.trigger, 1, fresh.numlock);
+    }
+    return rebind;
+}
+
+/**
+ * Switch over to a fresh config
+ *
+ * The keys are only grabbed again if the bindings have changed. The backend
+ * settings cannot be changed on the fly, they are kept as they are.
+ */
+static void
+reload_config (OutputSink &output, RawKeys *raw, config_t &cfg,
+               mouse_state_t &state, config_t &fresh)
+{
+    fresh.reactor = cfg.reactor;
+    fresh.xinput2 = cfg.xinput2;
+    fresh.evdev = cfg.evdev;
+    fresh.uinput = cfg.uinput;
+    fresh.relative = cfg.relative;
+    fresh.realtime = cfg.realtime;
+    fresh.displays = cfg.displays;
+    fresh.control = cfg.control;
+    record_config(fresh);
+
+    if (rebind_keys(output, raw, cfg, state, fresh)) {
+        dbug(DEBUG_LEVEL_NORMAL, DEBUG_TYPE_FRAMEWORK,
+             "bindings changed, keys grabbed again");
+    }
+
+    cfg = fresh;
+    state.motion.configure(cfg.motion);
+    state.scroll.configure(cfg.scroll);
+
+    dbug(DEBUG_LEVEL_NORMAL, DEBUG_TYPE_FRAMEWORK,
+         "config reloaded");
+}
+
+/**
+ * Look up the keycode of a keysym from the config
+ *
+ * Without a keymap, the built-in table of the evdev backend is used.
+ */
+static KeyCode
+get_keycode (const Keymap *keymap, KeySym keysym)
+{
+    if (NULL == keymap) {
+        return evdev_keysym_to_keycode(keysym);
+    }
+    return keymap->lookup(keysym);
+}
+
+/**
+ * Resolve the keysyms of a config with the keymap of its display
+ *
+ * Binding keycodes are looked up in the local index of the keymap, there are
+ * no requests to the server. Without a keymap (evdev, the simulator), they are
+ * looked up in the table of the evdev backend.
+ */
+static void
+resolve_keys (config_t &cfg, const Keymap *keymap)
+{
+    cfg.trigger = get_keycode(keymap, cfg.trigger_sym);
+    cfg.bindings = Bindings();
+    for (size_t i = 0; i < cfg.keys.size(); i++) {
+        const key_binding_t &key = cfg.keys[i];
+        KeyCode code = get_keycode(keymap, key.keysym);
+        if (!cfg.bindings.add(code, key.type, key.arg)) {
+            dbug(DEBUG_LEVEL_WARNING, DEBUG_TYPE_FRAMEWORK,
+                 "cannot bind " << XKeysymToString(key.keysym) << " to " <<
+                 key.action <<
+                 (code ? ", it is already bound" : ", unknown key"));
+        }
+    }
+    cfg.bindings.compile();
+}
+
+/**
+ * Follow a change of the keymap
+ *
+ * The config is resolved again from the keysyms it already has, the file is
+ * not read; only the keys whose keycode has changed are grabbed again.
+ */
+static void
+remap_keys (OutputSink &output, RawKeys *raw, const Keymap &keymap,
+            config_t &cfg, mouse_state_t &state)
+{
+    config_t fresh = cfg;
+    resolve_keys(fresh, &keymap);
+    if ((fresh.bindings == cfg.bindings) && (fresh.trigger == cfg.trigger)) {
+        return;
+    }
+
+    /* the config goes first, a replay releases the buttons after it */
+    record_config(fresh);
+    rebind_keys(output, raw, cfg, state, fresh);
+    cfg.trigger = fresh.trigger;
+    cfg.bindings = fresh.bindings;
+
+    dbug(DEBUG_LEVEL_NORMAL, DEBUG_TYPE_FRAMEWORK,
+         "keymap changed, keys bound again");
+}
+
+/**
+ * Send the button events of a key transition taken from the event stream
+ *
+ * The polling loop samples the keyboard once per tick, so a tap shorter than
+ * that would never show up in a sample. The keys bound to buttons follow their
+ * KeyPress/KeyRelease events instead, every one of them and in order, and only
+ * the other keys are sampled. An auto-repeated press is ignored.
+ */
+static void
+click_key (OutputSink &output, const Monitors &monitors, config_t &cfg,
+           mouse_state_t &state, const input_event_t &event)
+{
+    if (!keyset_test(cfg.bindings.button_keys(), event.code) ||
+        (keyset_test(state.clicks, event.code) == event.pressed)) {
+        return;
+    }
+    keyset_set(state.clicks, event.code, event.pressed);
+    stats.key_events++;
+    if (recorder) {
+        recorder->write(event.time, TRACE_CLICK, event.code, event.pressed);
+    }
+
+    /* a button key lands the grid first, as it would on a tick */
+    keyset_t keys = state.keys;
+    keyset_set(keys, event.code, event.pressed);
+    update_grid(output, monitors, cfg, keys, state);
+    update_keys(output, cfg, keys, state);
+    note_click(event.time);
+}
+
+/**
+ * Main loop processes key events
+ *
+ * This is the polling variant: while the mouse is grabbed, the keyboard state
+ * is queried from the input once per tick period, and the key events that came
+ * in meanwhile are taken for the button keys (see click_key()), so no click is
+ * lost however long the period is. The ticks are paced with absolute
+ * deadlines, so the time a tick takes does not add up; a deadline that has
+ * already passed is skipped and counted as an overrun. The input is
+ * the X server or the simulator, the loop does not know which; it returns when
+ * the input runs out. Fresh configs are picked up from the given slot, their
+ * keys are resolved with the keymap (the simulator has none, see
+ * resolve_keys()).
+ */
+static void
+main_loop (InputSource &input, OutputSink &output, Monitors &monitors,
+           Windows &windows, const Keymap *keymap, config_t &cfg,
+           std::atomic<config_t*> &slot)
+{
+    input_event_t event;
+    mouse_state_t state = mouse_state_t();
+    state.motion.configure(cfg.motion);
+    state.scroll.configure(cfg.scroll);
+    uint64_t last_tick = 0;
+    uint64_t deadline = 0;
+
+    while (!input.done() && !quit.load()) {
+        /* switch over to the new config if it has changed */
+        config_t *fresh = take_config(slot);
+        if (fresh) {
+            resolve_keys(*fresh, keymap);
+            reload_config(output, NULL, cfg, state, *fresh);
+            delete fresh;
+        }
+
+        /*
+         * Waiting for the next event blocks execution, which is okay if we
+         * don't have the mouse, but otherwise we must make sure there is an
+         * event waiting in the queue to be processed
+         */
+        if (!state.grab_active || input.pending()) {
+            do {
+                input.next_event(event);
+                if ((INPUT_KEY == event.type) && event.pressed &&
+                    (event.code == cfg.trigger)) {
+                    toggle_grab(output, NULL, cfg, state);
+                    keyset_clear(state.clicks);
+                } else if ((INPUT_KEY == event.type) && state.grab_active) {
+                    click_key(output, monitors, cfg, state, event);
+                } else if (INPUT_LAYOUT == event.type) {
+                    record_layout(monitors);
+                } else if ((INPUT_KEYMAP == event.type) && keymap) {
+                    remap_keys(output, NULL, *keymap, cfg, state);
+                }
+            } while (state.grab_active && input.pending());
+        }
+
+        /*
+         * If the mouse is ours, query the pressed keys and update movements and
+         * clicks as necessary
+         */
+        if (state.grab_active) {
+            /* how far the tick period is from the one we aim for */
+            uint64_t period = tick_period(cfg, &monitors);
+            uint64_t tick = input.now();
+            if (last_tick) {
+                int64_t error = ((int64_t)(tick - last_tick) -
+                                 (int64_t)period) / 1000;
+                stats.tick_jitter.record(error < 0 ? -error : error);
+            } else {
+                deadline = tick;
+            }
+            unsigned long round_trips = output.round_trips();
+
+            keyset_t pressed_keys;
+            input.query_keys(pressed_keys);
+
+            /*
+             * The button keys are as their events left them, the others went
+             * down some time after the previous query
+             */
+            const keyset_t &buttons = cfg.bindings.button_keys();
+            keyset_t changed;
+            for (int i = 0; i < 4; i++) {
+                pressed_keys.bits[i] =
+                    (pressed_keys.bits[i] & ~buttons.bits[i]) |
+                    (state.clicks.bits[i] & buttons.bits[i]);
+                changed.bits[i] = pressed_keys.bits[i] ^ state.keys.bits[i];
+                stats.key_events += __builtin_popcountll(changed.bits[i]);
+            }
+            for (int code = keyset_pop(changed); code >= 0;
+                 code = keyset_pop(changed)) {
+                bool pressed = keyset_test(pressed_keys, code);
+                if (pressed) {
+                    note_press(cfg, state, code, last_tick ? last_tick : tick);
+                }
+                if (recorder) {
+                    recorder->write(tick, TRACE_KEY, code, pressed);
+                }
+            }
+            if (recorder) {
+                recorder->write(tick, TRACE_TICK);
+            }
+
+            /* update the grid, snaps, direction flags and clicks */
+            update_grid(output, monitors, cfg, pressed_keys, state);
+            update_snap(output, monitors, windows, cfg, pressed_keys, state);
+            update_keys(output, cfg, pressed_keys, state);
+
+            /* move the mouse */
+            move_mouse(output, monitors, cfg, state, tick);
+
+            /*
+             * Ask for the next keyboard state already, so that its reply (if
+             * the backend can pipeline it) arrives while we sleep
+             */
+            input.request_keys();
+
+            /* refresh the screen */
+            uint64_t flush_start = framework::monotonic_ns();
+            output.flush();
+            stats.flush_time.record((framework::monotonic_ns() - flush_start) /
+                                    1000);
+            stats.round_trips.record(output.round_trips() - round_trips);
+            stats.ticks++;
+            last_tick = tick;
+
+            /* take a break until the next deadline we can still make */
+            deadline += period;
+            uint64_t now = input.now();
+            if (deadline <= now) {
+                uint64_t missed = (now - deadline) / period + 1;
+                note_overrun(missed);
+                deadline += missed * period;
+            }
+            input.sleep_until(deadline);
+        } else {
+            last_tick = 0;
+        }
+    }
+}
+
+/**
+ * Arm the movement timer with the given period (nsec), or disarm it with 0
+ *
+ * The timer fires once per tick period while a direction key is held, and it
+ * is disarmed otherwise, so an idle grab does not wake us up at all. Its
+ * expirations are on a fixed grid, they do not drift however late we read it.
+ */
+static void
+set_move_timer (int timer_fd, uint64_t period)
+{
+    struct itimerspec spec = itimerspec();
+    spec.it_interval.tv_sec = period / 1000000000ULL;
+    spec.it_interval.tv_nsec = period % 1000000000ULL;
+    spec.it_value = spec.it_interval;
+    timerfd_settime(timer_fd, 0, &spec, NULL);
+}
+
+/**
+ * Grab or release the mouse of a session, letting go of what it was holding
+ */
+static void
+toggle_session_grab (session_t &s)
+{
+    toggle_grab(*s.x, s.raw, s.cfg, s.state);
+    if (!s.state.grab_active) {
+        /* let go of everything we were holding */
+        keyset_t released;
+        keyset_clear(released);
+        update_keys(*s.x, s.cfg, released, s.state);
+
+        /* core events of keys that are no longer grabbed won't come */
+        if (!s.raw) {
+            keyset_clear(s.pressed_keys);
+        }
+    }
+}
+
+/**
+ * Process a key transition in the reactor loop
+ */
+static void
+handle_key (session_t &s, KeyCode code, bool pressed, Time time)
+{
+    config_t &cfg = s.cfg;
+    mouse_state_t &state = s.state;
+    uint64_t now = framework::monotonic_ns();
+    keyset_set(s.pressed_keys, code, pressed);
+    stats.key_events++;
+    if (recorder) {
+        recorder->write(now, TRACE_KEY, code, pressed);
+    }
+
+    if (pressed && (code == cfg.trigger)) {
+        toggle_session_grab(s);
+        if (!state.grab_active) {
+            return;
+        }
+    } else if (!state.grab_active) {
+        return;
+    }
+
+    if (pressed) {
+        note_press(cfg, state, code, server_time_ns(time));
+    }
+
+    /* update the grid, snaps, direction flags and clicks */
+    bool was_moving = in_motion(state);
+    update_grid(*s.x, *s.monitors, cfg, s.pressed_keys, state);
+    update_snap(*s.x, *s.monitors, *s.windows, cfg, s.pressed_keys, state);
+    update_keys(*s.x, cfg, s.pressed_keys, state);
+    if (keyset_test(cfg.bindings.button_keys(), code)) {
+        note_click(server_time_ns(time));
+    }
+
+    /* make the first step right away when starting to move */
+    if (!was_moving && in_motion(state)) {
+        move_mouse(*s.x, *s.monitors, cfg, state, now);
+    }
+}
+
+/**
+ * Do whatever a session has to do, short of sleeping
+ *
+ * Picks up a fresh config, processes every event already read from the
+ * connection, arms or disarms the movement timer and sends out the requests.
+ * Nothing is left in the Xlib queue afterwards, so the session has nothing to
+ * do until its connection or its timer becomes readable.
+ */
+static void
+service_session (session_t &s)
+{
+    XEvent event;
+
+    /* switch over to the new config if it has changed */
+    config_t *fresh = take_config(s.fresh);
+    if (fresh) {
+        resolve_keys(*fresh, s.keymap);
+        reload_config(*s.x, s.raw, s.cfg, s.state, *fresh);
+        delete fresh;
+        if (s.state.grab_active) {
+            update_keys(*s.x, s.cfg, s.pressed_keys, s.state);
+        }
+    }
+
+    /* process every event already read from the connection */
+    while (XPending(s.display)) {
+        XNextEvent(s.display, &event);
+
+        KeyCode code;
+        bool pressed;
+        Time time;
+        if (s.monitors->handle_event(event)) {
+            record_layout(*s.monitors);
+            continue;
+        } else if (s.keymap->handle_event(event)) {
+            remap_keys(*s.x, s.raw, *s.keymap, s.cfg, s.state);
+            if (s.state.grab_active) {
+                update_keys(*s.x, s.cfg, s.pressed_keys, s.state);
+            }
+            continue;
+        } else if (s.windows->handle_event(event)) {
+            continue;
+        } else if (s.raw) {
+            if (!s.raw->translate(event, code, pressed, time)) {
+                continue;
+            }
+        } else if ((KeyPress == event.type) || (KeyRelease == event.type)) {
+            code = event.xkey.keycode;
+            pressed = (KeyPress == event.type);
+            time = event.xkey.time;
+        } else {
+            continue;
+        }
+
+        handle_key(s, code, pressed, time);
+    }
+
+    /*
+     * The timer only runs while the mouse is moving, it is armed again if the
+     * period changes with the config or the monitors
+     */
+    uint64_t period = 0;
+    if (s.state.grab_active && in_motion(s.state)) {
+        period = tick_period(s.cfg, s.monitors);
+    }
+    if (period != s.timer_period) {
+        set_move_timer(s.timer_fd, period);
+        s.timer_period = period;
+        s.last_tick = 0;
+    }
+
+    /* send out whatever we have generated so far */
+    uint64_t flush_start = framework::monotonic_ns();
+    s.x->flush();
+    stats.flush_time.record((framework::monotonic_ns() - flush_start) / 1000);
+}
+
+/**
+ * Move the mouse of a session on timer expiry
+ */
+static void
+tick_session (session_t &s)
+{
+    uint64_t expirations;
+    if ((read(s.timer_fd, &expirations, sizeof(expirations)) <= 0) ||
+        !s.timer_period) {
+        return;
+    }
+
+    /* the expirations we slept through are frames missed */
+    if (expirations > 1) {
+        note_overrun(expirations - 1);
+    }
+
+    /* how far the tick period is from the one we aim for */
+    uint64_t tick = framework::monotonic_ns();
+    if (s.last_tick) {
+        int64_t error = ((int64_t)(tick - s.last_tick) -
+                         (int64_t)(expirations * s.timer_period)) / 1000;
+        stats.tick_jitter.record(error < 0 ? -error : error);
+    }
+    s.last_tick = tick;
+    if (recorder) {
+        recorder->write(tick, TRACE_TICK);
+    }
+
+    unsigned long round_trips = s.x->round_trips();
+    move_mouse(*s.x, *s.monitors, s.cfg, s.state, tick);
+    stats.round_trips.record(s.x->round_trips() - round_trips);
+    stats.ticks++;
+}
+
+/**
+ * Carry out the requests that came in on the control socket
+ *
+ * Every request read so far is carried out on the given session, and nothing
+ * is flushed here: the session is serviced right afterwards, so a burst of
+ * requests goes out in a single flush. While the mouse is grabbed, the motion
+ * follows the same rules as the keys (the monitors in absolute mode).
+ */
+static void
+serve_control (session_t &s)
+{
+    std::vector<control_request_t> requests;
+    control->receive(requests);
+
+    config_t &cfg = s.cfg;
+    mouse_state_t &state = s.state;
+    for (size_t i = 0; i < requests.size(); i++) {
+        const control_request_t &request = requests[i];
+        stats.commands++;
+
+        switch (request.op) {
+        case CONTROL_MOVE:
+            if (state.grab_active && !cfg.relative) {
+                int x = state.mouse_x + request.a;
+                int y = state.mouse_y + request.b;
+                s.monitors->limit(state.mouse_x, state.mouse_y, x, y,
+                                  cfg.edges);
+                jump_pointer(*s.x, state, x, y);
+            } else {
+                s.x->move_pointer(request.a, request.b);
+                stats.warps++;
+            }
+            break;
+        case CONTROL_WARP:
+            jump_pointer(*s.x, state, request.a, request.b);
+            break;
+        case CONTROL_CLICK:
+            emit_button(*s.x, request.a, true);
+            emit_button(*s.x, request.a, false);
+            break;
+        case CONTROL_PRESS:
+            emit_button(*s.x, request.a, true);
+            break;
+        case CONTROL_RELEASE:
+            emit_button(*s.x, request.a, false);
+            break;
+        case CONTROL_GRAB:
+            if (state.grab_active != (1 == request.a)) {
+                toggle_session_grab(s);
+            }
+            break;
+        case CONTROL_STATS:
+            control->reply(request.client, stats_counters(stats));
+            break;
+        }
+    }
+}
+
+/**
+ * Register a file descriptor with the reactor, under the given tag
+ */
+static bool
+reactor_add (int epoll_fd, int fd, uint64_t tag)
+{
+    struct epoll_event event = epoll_event();
+    event.events = EPOLLIN;
+    event.data.u64 = tag;
+    return (0 == epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event));
+}
+
+/**
+ * Reactor loop processes key events
+ *
+ * This is the event-driven variant: the held keys are tracked locally from the
+ * KeyPress/KeyRelease events of the grabbed keys (or from the raw XInput2 key
+ * events, if the session has them), and the process sleeps in epoll_wait() on
+ * the X connections, one timerfd per session, the config reload eventfd and
+ * the control socket. A timer is only armed while the mouse of its session is
+ * actually moving, and only the sessions with something to do are looked at
+ * when we wake up, so an idle display costs nothing, however many there are.
+ * The control requests go to the first session.
+ */
+static void
+reactor_loop (std::vector<session_t*> &sessions)
+{
+    /* the connection of session i is tagged 2i, its timer 2i + 1 */
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    bool ready = (epoll_fd >= 0);
+    for (size_t i = 0; i < sessions.size(); i++) {
+        session_t &s = *sessions[i];
+        s.timer_fd = timerfd_create(CLOCK_MONOTONIC,
+                                    TFD_NONBLOCK | TFD_CLOEXEC);
+        ready = ready && (s.timer_fd >= 0) &&
+                reactor_add(epoll_fd, ConnectionNumber(s.display), 2 * i) &&
+                reactor_add(epoll_fd, s.timer_fd, 2 * i + 1);
+    }
+    if (ready && (reload_fd >= 0)) {
+        ready = reactor_add(epoll_fd, reload_fd, REACTOR_RELOAD_TAG);
+    }
+    if (ready && control) {
+        ready = reactor_add(epoll_fd, control->fd(), REACTOR_CONTROL_TAG);
+    }
+
+    if (!ready) {
+        dbug(DEBUG_LEVEL_ERROR, DEBUG_TYPE_FRAMEWORK,
+             "cannot set up the reactor: " << strerror(errno));
+        if (epoll_fd >= 0) {
+            close(epoll_fd);
+        }
+        for (size_t i = 0; i < sessions.size(); i++) {
+            if (sessions[i]->timer_fd >= 0) {
+                close(sessions[i]->timer_fd);
+                sessions[i]->timer_fd = -1;
+            }
+        }
+        if (1 == sessions.size()) {
+            dbug(DEBUG_LEVEL_ERROR, DEBUG_TYPE_FRAMEWORK,
+                 "falling back to polling");
+            session_t &s = *sessions[0];
+            XSource input(s.display, s.x, s.monitors, s.windows, s.keymap,
+                          reload_fd);
+            main_loop(input, *s.x, *s.monitors, *s.windows, s.keymap, s.cfg,
+                      s.fresh);
+        }
+        return;
+    }
+
+    /* whatever happened before we got here */
+    std::vector<bool> busy(sessions.size(), true);
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+
+    while (!quit.load()) {
+        for (size_t i = 0; i < sessions.size(); i++) {
+            if (busy[i]) {
+                service_session(*sessions[i]);
+                busy[i] = false;
+            }
+        }
+
+        /* sleep until there is something to do */
+        int count = epoll_wait(epoll_fd, events, REACTOR_MAX_EVENTS, -1);
+        if (count < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            dbug(DEBUG_LEVEL_ERROR, DEBUG_TYPE_FRAMEWORK,
+                 "epoll_wait() failed: " << strerror(errno));
+            break;
+        }
+
+        for (int i = 0; i < count; i++) {
+            uint64_t tag = events[i].data.u64;
+            if (REACTOR_RELOAD_TAG == tag) {
+                /* every session may have a fresh config */
+                busy.assign(sessions.size(), true);
+                continue;
+            } else if (REACTOR_CONTROL_TAG == tag) {
+                serve_control(*sessions[0]);
+                busy[0] = true;
+                continue;
+            }
+
+            /* move the mouse on timer expiry */
+            if (tag & 1) {
+                tick_session(*sessions[tag / 2]);
+            }
+            busy[tag / 2] = true;
+        }
+    }
+
+    for (size_t i = 0; i < sessions.size(); i++) {
+        close(sessions[i]->timer_fd);
+        sessions[i]->timer_fd = -1;
+    }
+    close(epoll_fd);
+}
+
+/**
+ * Evdev loop processes key events without an X server
+ *
+ * Key transitions are read from the evdev device, motion and clicks go out
+ * through uinput as relative events. The keyboard is only grabbed while the
+ * mouse is active, and the keys without a binding are passed on meanwhile.
+ */
+static void
+evdev_loop (Evdev &ev, config_t &cfg)
+{
+    mouse_state_t state = mouse_state_t();
+    state.motion.configure(cfg.motion);
+    state.scroll.configure(cfg.scroll);
+    keyset_t pressed_keys;
+    keyset_clear(pressed_keys);
+    uint64_t timer_period = 0;
+    bool want_grab = false;
+    bool grabbed = false;
+
+    /* movement timer */
+    int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd < 0) {
+        dbug(DEBUG_LEVEL_ERROR, DEBUG_TYPE_FRAMEWORK,
+             "timerfd_create() failed");
+        return;
+    }
+
+    /* keys that must not be passed on while the mouse is active */
+    keyset_t bound_keys = cfg.bindings.keys();
+    keyset_set(bound_keys, cfg.trigger, true);
+
+    struct pollfd fds[3];
+    fds[0].fd = ev.fd();
+    fds[0].events = POLLIN;
+    fds[1].fd = timer_fd;
+    fds[1].events = POLLIN;
+    fds[2].fd = reload_fd;
+    fds[2].events = POLLIN;
+
+    while (!ev.eof() && !quit.load()) {
+        /* switch over to the new config if it has changed */
+        config_t *fresh = take_config(fresh_config);
+        if (fresh) {
+            resolve_keys(*fresh, NULL);
+            if (!(fresh->bindings == cfg.bindings)) {
+                /* let go of the buttons held through the old bindings */
+                keyset_t released;
+                keyset_clear(released);
+                update_keys(ev, cfg, released, state);
+            }
+            fresh->evdev = cfg.evdev;
+            fresh->uinput = cfg.uinput;
+            fresh->realtime = cfg.realtime;
+            cfg = *fresh;
+            delete fresh;
+
+            state.motion.configure(cfg.motion);
+            state.scroll.configure(cfg.scroll);
+            bound_keys = cfg.bindings.keys();
+            keyset_set(bound_keys, cfg.trigger, true);
+            if (state.grab_active) {
+                update_keys(ev, cfg, pressed_keys, state);
+            }
+            ev.flush();
+
+            dbug(DEBUG_LEVEL_NORMAL, DEBUG_TYPE_FRAMEWORK,
+                 "config reloaded");
+        }
+
+        if (poll(fds, 3, -1) < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            dbug(DEBUG_LEVEL_ERROR, DEBUG_TYPE_FRAMEWORK,
+                 "poll() failed: " << strerror(errno));
+            break;
+        }
+
+        /* process every pending key transition */
+        unsigned int code;
+        bool pressed;
+        unsigned long when;
+        while (ev.read_key(code, pressed, when)) {
+            if (code > 0xff) {
+                continue;
+            }
+            keyset_set(pressed_keys, code, pressed);
+
+            if (pressed && (code == cfg.trigger)) {
+                if (state.grab_active) {
+                    state.grab_active = false;
+                    keyset_t released;
+                    keyset_clear(released);
+                    update_keys(ev, cfg, released, state);
+                    dbug(DEBUG_LEVEL_NORMAL, DEBUG_TYPE_FRAMEWORK,
+                         "mouse released");
+                } else {
+                    want_grab = !want_grab;
+                }
+            } else if (grabbed && !keyset_test(bound_keys, code)) {
+                ev.forward_key(code, pressed);
+            } else if (state.grab_active) {
+                /* update direction flags and clicks */
+                bool was_moving = in_motion(state);
+                update_keys(ev, cfg, pressed_keys, state);
+
+                /* make the first step right away when starting to move */
+                if (!was_moving && in_motion(state)) {
+                    uint64_t now = framework::monotonic_ns();
+                    int dx, dy;
+                    get_step(state, now, dx, dy);
+                    ev.move_pointer(dx, dy);
+                    scroll_wheel(ev, state, now);
+                }
+            }
+
+            /*
+             * The device is grabbed and let go only while no key is held, so
+             * every key goes down and comes up on the same side of the grab:
+             * a press the system has seen is never followed by a release it
+             * does not get, and the other way round
+             */
+            if (keyset_any(pressed_keys, pressed_keys)) {
+                continue;
+            }
+            if (want_grab) {
+                want_grab = false;
+                grabbed = true;
+                state.grab_active = true;
+                ev.grab(true);
+                dbug(DEBUG_LEVEL_NORMAL, DEBUG_TYPE_FRAMEWORK,
+                     "mouse grabbed");
+            } else if (grabbed && !state.grab_active) {
+                grabbed = false;
+                ev.grab(false);
+            }
+        }
+
+        /* move the mouse on timer expiry */
+        if (fds[1].revents & POLLIN) {
+            uint64_t expirations;
+            if ((read(timer_fd, &expirations, sizeof(expirations)) > 0) &&
+                timer_period) {
+                if (expirations > 1) {
+                    note_overrun(expirations - 1);
+                }
+                uint64_t now = framework::monotonic_ns();
+                int dx, dy;
+                get_step(state, now, dx, dy);
+                ev.move_pointer(dx, dy);
+                scroll_wheel(ev, state, now);
+            }
+        }
+
+        /* the timer only runs while the mouse is moving */
+        uint64_t period = 0;
+        if (state.grab_active && in_motion(state)) {
+            period = tick_period(cfg, NULL);
+        }
+        if (period != timer_period) {
+            set_move_timer(timer_fd, period);
+            timer_period = period;
+        }
+
+        /* send out whatever we have generated, with a single write */
+        ev.flush();
+    }
+
+    close(timer_fd);
+}
+
+/**
+ * Replay output, collects the emitted events instead of sending them anywhere
+ */
+class ReplayOutput {
+  public:
+    /** events emitted but not compared with the trace yet */
+    std::deque<trace_record_t> events;
+
+    /** press or release a mouse button */
+    void fake_button (unsigned int button, bool press)
+    {
+        push(TRACE_BUTTON, button, press, 0, 0);
+    }
+
+    /** move the pointer to the given coordinates */
+    void warp_pointer (int x, int y)
+    {
+        push(TRACE_WARP, 0, 0, x, y);
+    }
+
+    /** move the pointer relative to its current position */
+    void move_pointer (int dx, int dy)
+    {
+        push(TRACE_MOVE, 0, 0, dx, dy);
+    }
+
+    /** turn the wheels by whole notches */
+    void scroll (int dx, int dy)
+    {
+        push(TRACE_SCROLL, 0, 0, dx, dy);
+    }
+
+    /** the grid is not recorded, only the warp it ends with */
+    void show_grid (int x, int y, int width, int height)
+    {
+    }
+
+    /** the grid is not recorded */
+    void hide_grid (void)
+    {
+    }
+
+  private:
+    void push (trace_type_t type, unsigned int code, int value, int x, int y)
+    {
+        trace_record_t record = trace_record_t();
+        record.type = type;
+        record.code = code;
+        record.value = value;
+        record.x = x;
+        record.y = y;
+        events.push_back(record);
+    }
+};
+
 /**
- * Update mouse global coordinates
+ * Describe an emitted event of a trace, for the replay report
  */
-static void
-update_mouse_coordinates (Display *display, Window &root, int &mouse_x, int &mouse_y)
+static std::string
+describe_event (const trace_record_t &record)
 {
-    /* query window properties */
-    Atom atom;
-    int format;
-    unsigned long items, bytes;
-    Window *properties;
-    XGetWindowProperty(display, root, XInternAtom(display, "_NET_ACTIVE_WINDOW",
-                                                  True),
-                       0, 1, False, AnyPropertyType, &atom, &format, &items,
-                       &bytes, (unsigned char**)&properties);
-
-    /* get mouse position */
-    Window tmpwin1, tmpwin2;
-    int tmp_x, tmp_y;
-    unsigned int mask;
-    XQueryPointer(display, properties[0], &tmpwin1, &tmpwin2,
-                  &mouse_x, &mouse_y, &tmp_x, &tmp_y, &mask);
-
-    /* cleanup */
-    XFree(properties);
+    std::stringstream strstr;
+    if (TRACE_BUTTON == record.type) {
+        strstr << "button " << record.code << (record.value ? " down" : " up");
+    } else if (TRACE_WARP == record.type) {
+        strstr << "warp to " << record.x << "," << record.y;
+    } else if (TRACE_SCROLL == record.type) {
+        strstr << "scroll by " << record.x << "," << record.y;
+    } else {
+        strstr << "move by " << record.x << "," << record.y;
+    }
+    return strstr.str();
 }
 
 /**
- * Main loop processes key events
+ * Replay a trace recorded with -r
+ *
+ * The recorded inputs (key transitions, ticks, grabs, config and monitor
+ * layout) are fed through the same motion and click logic the loops use, with
+ * the recorded timestamps, and every emitted event is compared with the
+ * recorded one. No X server is needed. Returns RC_OK if the output is
+ * identical. The window geometry is not recorded, so snapping to the windows
+ * only replays as far as the edges of the monitors go.
  */
-static void
-main_loop (Display *display, Window &root, config_t &cfg)
+static int
+replay (const std::string &path)
 {
-    XEvent event;
-    bool mouse_grab_active = false;
-    bool clicking = false;
-    bool pasting = false;
-    int move_state = STOP;
-    int mouse_x;
-    int mouse_y;
+    TraceReader trace;
+    if (!trace.open(path)) {
+        return RC_MAIN_TRACE_ERROR;
+    }
 
-    while (true) {
-        /*
-         * Waiting for the next event blocks execution, which is okay if we
-         * don't have the mouse, but otherwise we must make sure there is an
-         * event waiting in the queue to be processed
-         */
-        if (!mouse_grab_active || XPending(display)) {
-            XNextEvent(display, &event);
-            if ((KeyPress == event.type) && (event.xkey.keycode == cfg.trigger)) {
-                if (mouse_grab_active) {
-                    /* release the mouse */
-                    XUngrabKey(display, cfg.up, cfg.numlock, root);
-                    XUngrabKey(display, cfg.left, cfg.numlock, root);
-                    XUngrabKey(display, cfg.down, cfg.numlock, root);
-                    XUngrabKey(display, cfg.right, cfg.numlock, root);
-                    XUngrabKey(display, cfg.click, cfg.numlock, root);
-                    XUngrabKey(display, cfg.paste, cfg.numlock, root);
-                    XUngrabKey(display, cfg.slow, cfg.numlock, root);
+    ReplayOutput output;
+    Monitors monitors(NULL, None);
+    Windows windows(NULL, None);
+    std::vector<monitor_t> layout;
+    config_t cfg = config_t();
+    config_t fresh = config_t();
+    int config_left = -1;
+    bool configured = false;
+    trace_loop_t loop = TRACE_LOOP_POLLING;
+    mouse_state_t state = mouse_state_t();
+    keyset_t pressed_keys;
+    keyset_clear(pressed_keys);
+    uint64_t trigger_time = 0;
+    unsigned long records = 0, sessions = 0, compared = 0, mismatches = 0;
 
-                    dbug(DEBUG_LEVEL_NORMAL, DEBUG_TYPE_FRAMEWORK,
-                         "mouse released");
-                } else {
-                    /* grab the mouse */
-                    XGrabKey(display, cfg.up, cfg.numlock, root, False,
-                             GrabModeAsync, GrabModeAsync);
-                    XGrabKey(display, cfg.left, cfg.numlock, root, False,
-                             GrabModeAsync, GrabModeAsync);
-                    XGrabKey(display, cfg.down, cfg.numlock, root, False,
-                             GrabModeAsync, GrabModeAsync);
-                    XGrabKey(display, cfg.right, cfg.numlock, root, False,
-                             GrabModeAsync, GrabModeAsync);
-                    XGrabKey(display, cfg.click, cfg.numlock, root, False,
-                             GrabModeAsync, GrabModeAsync);
-                    XGrabKey(display, cfg.paste, cfg.numlock, root, False,
-                             GrabModeAsync, GrabModeAsync);
-                    XGrabKey(display, cfg.slow, cfg.numlock, root, False,
-                             GrabModeAsync, GrabModeAsync);
-
-                    /* update mouse coordinates */
-                    update_mouse_coordinates(display, root, mouse_x, mouse_y);
+    trace_record_t record;
+    while (trace.read(record)) {
+        records++;
+        switch (record.type) {
+        case TRACE_HEADER:
+            if ((TRACE_MAGIC != record.time) ||
+                (record.code < TRACE_VERSION_OLDEST) ||
+                (record.code > TRACE_VERSION)) {
+                std::cout << path << ": not a keymouse trace, or version "
+                          << record.code << " is not supported" << std::endl;
+                return RC_MAIN_TRACE_ERROR;
+            }
+            loop = (trace_loop_t)record.value;
+            state = mouse_state_t();
+            keyset_clear(pressed_keys);
+            configured = false;
+            sessions++;
+            break;
 
-                    dbug(DEBUG_LEVEL_NORMAL, DEBUG_TYPE_FRAMEWORK,
-                         "mouse grabbed");
-                }
-                mouse_grab_active = !mouse_grab_active;
+        case TRACE_CONFIG:
+            fresh = config_t();
+            fresh.trigger = record.code;
+            fresh.relative = record.value & TRACE_FLAG_RELATIVE;
+            fresh.numlock = (record.value & TRACE_FLAG_NUMLOCK) ? Mod2Mask : 0;
+            fresh.edges = (edge_mode_t)record.x;
+            config_left = TRACE_PARAM_COUNT + record.y;
+            break;
+
+        case TRACE_PARAM: {
+            double value = TraceReader::value_double(record);
+            if (TRACE_PARAM_SPEED == record.code) {
+                fresh.motion.speed = value;
+            } else if (TRACE_PARAM_MAX_SPEED == record.code) {
+                fresh.motion.max_speed = value;
+            } else if (TRACE_PARAM_SLOW_SPEED == record.code) {
+                fresh.motion.slow_speed = value;
+            } else if (TRACE_PARAM_ACCEL_TIME == record.code) {
+                fresh.motion.accel_time = value;
+                fresh.scroll.accel_time = value;
+            } else if (TRACE_PARAM_CURVE == record.code) {
+                fresh.motion.curve = (accel_curve_t)(int)value;
+            } else if (TRACE_PARAM_SCROLL_SPEED == record.code) {
+                fresh.scroll.speed = value;
+            } else if (TRACE_PARAM_SCROLL_MAX_SPEED == record.code) {
+                fresh.scroll.max_speed = value;
+            } else if (TRACE_PARAM_SCROLL_SLOW_SPEED == record.code) {
+                fresh.scroll.slow_speed = value;
+            } else if (TRACE_PARAM_SCROLL_CURVE == record.code) {
+                fresh.scroll.curve = (accel_curve_t)(int)value;
             }
+            config_left--;
+            break;
         }
 
-        /*
-         * If the mouse is ours, query the pressed keys and update movements and
-         * clicks as necessary
-         */
-        if (mouse_grab_active) {
-            char pressed_keys[32];
-            XQueryKeymap(display, pressed_keys);
+        case TRACE_BIND:
+            fresh.bindings.add(record.code, (action_type_t)record.value,
+                               record.x);
+            config_left--;
+            break;
 
-            /* update UP direction flag */
-            if ((pressed_keys[cfg.up >> 3] >> (cfg.up & 0x07)) & 0x01) {
-                move_state |= UP;
-            } else {
-                move_state &= ~UP;
+        case TRACE_LAYOUT:
+            if (0 == record.code) {
+                layout.clear();
             }
-
-            /* update LEFT direction flag */
-            if ((pressed_keys[cfg.left >> 3] >> (cfg.left & 0x07)) & 0x01) {
-                move_state |= LEFT;
-            } else {
-                move_state &= ~LEFT;
+            monitor_t monitor;
+            monitor.x = record.x;
+            monitor.y = record.y;
+            monitor.width = record.w;
+            monitor.height = record.h;
+            layout.push_back(monitor);
+            if (record.code + 1 == record.value) {
+                monitors.set_layout(layout);
             }
+            break;
 
-            /* update DOWN direction flag */
-            if ((pressed_keys[cfg.down >> 3] >> (cfg.down & 0x07)) & 0x01) {
-                move_state |= DOWN;
-            } else {
-                move_state &= ~DOWN;
+        case TRACE_GRAB:
+            state.grab_active = record.value;
+            state.mouse_x = record.x;
+            state.mouse_y = record.y;
+            if (TRACE_LOOP_POLLING == loop) {
+                break;
             }
-
-            /* update RIGHT direction flag */
-            if ((pressed_keys[cfg.right >> 3] >> (cfg.right & 0x07)) & 0x01) {
-                move_state |= RIGHT;
-            } else {
-                move_state &= ~RIGHT;
+            if (!state.grab_active) {
+                /* let go of everything we were holding */
+                keyset_t released;
+                keyset_clear(released);
+                state.grid_active = false;
+                update_keys(output, cfg, released, state);
+                if (TRACE_LOOP_RAW != loop) {
+                    keyset_clear(pressed_keys);
+                }
+                break;
             }
+            /* the trigger press goes on as any other key press */
+            record.time = trigger_time;
+            /* fall through */
 
-            /* update click states */
-            bool send_click_event = false;
-            if (clicking != pressed_keys[cfg.click >> 3] >> (cfg.click & 0x07)) {
-                /* send corresponding left click event */
-                clicking = pressed_keys[cfg.click >> 3] >> (cfg.click & 0x07);
-                send_click_event = true;
+        case TRACE_KEY:
+            if (TRACE_KEY == record.type) {
+                keyset_set(pressed_keys, record.code, record.value);
+                if (TRACE_LOOP_POLLING == loop) {
+                    break;
+                }
+                if (record.value && (record.code == cfg.trigger)) {
+                    /* the grab record tells what happened */
+                    trigger_time = record.time;
+                    break;
+                }
+                if (!state.grab_active) {
+                    break;
+                }
             }
-            bool send_paste_event = false;
-            if (pasting != pressed_keys[cfg.paste >> 3] >> (cfg.paste & 0x07)) {
-                /* send paste event only on keyrelease */
-                if (pasting) {
-                    send_paste_event = true;
+            {
+                bool was_moving = in_motion(state);
+                update_grid(output, monitors, cfg, pressed_keys, state);
+                update_snap(output, monitors, windows, cfg, pressed_keys,
+                            state);
+                update_keys(output, cfg, pressed_keys, state);
+                if (!was_moving && in_motion(state)) {
+                    move_mouse(output, monitors, cfg, state, record.time);
                 }
-                pasting = pressed_keys[cfg.paste >> 3] >> (cfg.paste & 0x07);
             }
+            break;
 
-            /* set speed */
-            int pixels = cfg.speed;
-            if ((pressed_keys[cfg.slow >> 3] >> (cfg.slow & 0x07)) & 0x01) {
-                pixels = 1;
-            }
+        case TRACE_CLICK: {
+            /* a button key of the polling loop, taken at once */
+            keyset_set(pressed_keys, record.code, record.value);
+            keyset_t keys = state.keys;
+            keyset_set(keys, record.code, record.value);
+            update_grid(output, monitors, cfg, keys, state);
+            update_keys(output, cfg, keys, state);
+            break;
+        }
 
-            /* move mouse up or down */
-            if (UP & move_state) {
-                if (mouse_y >= pixels) {
-                    mouse_y -= pixels;
-                }
-            } else if (DOWN & move_state) {
-                /* TODO: get window size and limit movement */
-                mouse_y += pixels;
+        case TRACE_TICK:
+            if (TRACE_LOOP_POLLING == loop) {
+                update_grid(output, monitors, cfg, pressed_keys, state);
+                update_snap(output, monitors, windows, cfg, pressed_keys,
+                            state);
+                update_keys(output, cfg, pressed_keys, state);
             }
+            move_mouse(output, monitors, cfg, state, record.time);
+            break;
 
-            /* move mouse left or right */
-            if (LEFT & move_state) {
-                if (mouse_x >= pixels) {
-                    mouse_x -= pixels;
+        case TRACE_WARP:
+        case TRACE_MOVE:
+        case TRACE_BUTTON:
+        case TRACE_SCROLL: {
+            compared++;
+            trace_record_t emitted = trace_record_t();
+            bool missing = output.events.empty();
+            if (!missing) {
+                emitted = output.events.front();
+                output.events.pop_front();
+            }
+            if (missing || (emitted.type != record.type) ||
+                (emitted.code != record.code) ||
+                (emitted.value != record.value) || (emitted.x != record.x) ||
+                (emitted.y != record.y)) {
+                if (mismatches++ < 10) {
+                    std::cout << "record " << records << ": recorded "
+                              << describe_event(record) << ", replayed "
+                              << (missing ? "nothing" : describe_event(emitted))
+                              << std::endl;
                 }
-            } else if (RIGHT & move_state) {
-                /* TODO: get window size and limit movement */
-                mouse_x += pixels;
             }
+            break;
+        }
 
-            /* put the mouse in its new position */
-            XWarpPointer(display, None, root, 0, 0, 0, 0, mouse_x, mouse_y);
+        default:
+            std::cout << "record " << records << ": unknown type "
+                      << record.type << std::endl;
+            return RC_MAIN_TRACE_ERROR;
+        }
 
-            /* send left click event */
-            if (send_click_event) {
-                if (clicking) {
-                    /* mouse left button down event */
-                    XTestFakeButtonEvent(display, 1, True, CurrentTime);
-                } else {
-                    /* mouse left button up event */
-                    XTestFakeButtonEvent(display, 1, False, CurrentTime);
+        /* switch over once the config block is complete */
+        if (0 == config_left) {
+            fresh.bindings.compile();
+            if (configured) {
+                bool regrab = !(fresh.bindings == cfg.bindings) ||
+                              (fresh.numlock != cfg.numlock);
+                if (regrab) {
+                    keyset_t released;
+                    keyset_clear(released);
+                    update_keys(output, cfg, released, state);
+
+                    /* the polling loop records the keys against these */
+                    if (TRACE_LOOP_POLLING == loop) {
+                        pressed_keys = state.keys;
+                    }
                 }
             }
-
-            /* send paste event */
-            if (send_paste_event) {
-                /* mouse middle button down-up event */
-                XTestFakeButtonEvent(display, 2, True, CurrentTime);
-                XTestFakeButtonEvent(display, 2, False, CurrentTime);
+            cfg = fresh;
+            state.motion.configure(cfg.motion);
+            state.scroll.configure(cfg.scroll);
+            if (configured && (TRACE_LOOP_POLLING != loop) &&
+                state.grab_active) {
+                update_keys(output, cfg, pressed_keys, state);
             }
+            configured = true;
+            config_left = -1;
+        }
+    }
 
-            /* refresh the screen */
-            XFlush(display);
+    /* whatever is left was not in the recording */
+    mismatches += output.events.size();
 
-            /* take a break */
-            usleep(cfg.sleep);
-        }
+    std::cout << "replayed " << records << " records in " << sessions
+              << " session(s), " << compared << " emitted events compared, "
+              << mismatches << " mismatch(es)" << std::endl;
+    return mismatches ? RC_MAIN_REPLAY_MISMATCH : RC_OK;
+}
+
+/**
+ * Run the polling loop on the simulator
+ *
+ * The simulated keyboard grabs the mouse and then plays with every bound key
+ * until the virtual time is up, on a single 1920x1080 monitor with three
+ * windows. Nothing waits for real time, so this measures the cost of the loop
+ * logic alone.
+ */
+static int
+simulate (config_t &cfg, double seconds)
+{
+    SimInput input((uint64_t)(seconds * 1e9));
+    input.script_session(cfg.trigger, cfg.bindings);
+    SimOutput output(960, 540);
+
+    Monitors monitors(NULL, None);
+    std::vector<monitor_t> layout(1);
+    layout[0].x = 0;
+    layout[0].y = 0;
+    layout[0].width = 1920;
+    layout[0].height = 1080;
+    monitors.set_layout(layout);
+
+    /* a couple of overlapping windows to snap to */
+    Windows windows(NULL, None);
+    std::vector<monitor_t> rects(3);
+    for (size_t i = 0; i < rects.size(); i++) {
+        rects[i].x = 100 + 500 * i;
+        rects[i].y = 80 + 200 * i;
+        rects[i].width = 800;
+        rects[i].height = 600;
     }
+    windows.set_windows(rects);
+
+    uint64_t start = framework::monotonic_ns();
+    main_loop(input, output, monitors, windows, NULL, cfg, fresh_config);
+    uint64_t elapsed = framework::monotonic_ns() - start;
+
+    uint64_t ticks = stats.ticks.load();
+    std::cout << "simulated " << seconds << " s in " << elapsed / 1e6
+              << " ms: " << ticks << " ticks ("
+              << (ticks ? elapsed / ticks : 0) << " ns each), "
+              << output.motions << " motions, " << output.buttons
+              << " button events, " << output.notches
+              << " wheel notches, " << output.grids
+              << " grid updates, pointer at " << output.x << "," << output.y
+              << std::endl;
+    return RC_OK;
 }
 
 /**
  * Parse configuration
+ *
+ * The keys are only named here, resolve_keys() looks them up in a keymap.
  */
 static config_t
-parse_config (Display *display)
+parse_config (void)
 {
     config_t cfg;
     framework::Config *config = new framework::Config("keymouse");
 
     /* read values to the config structure */
-    cfg.trigger = XKeysymToKeycode(
-        display, XStringToKeysym(config->get_string("trigger").c_str()));
-    cfg.up = XKeysymToKeycode(
-        display, XStringToKeysym(config->get_string("up").c_str()));
-    cfg.left = XKeysymToKeycode(
-        display, XStringToKeysym(config->get_string("left").c_str()));
-    cfg.down = XKeysymToKeycode(
-        display, XStringToKeysym(config->get_string("down").c_str()));
-    cfg.right = XKeysymToKeycode(
-        display, XStringToKeysym(config->get_string("right").c_str()));
-    cfg.click = XKeysymToKeycode(
-        display, XStringToKeysym(config->get_string("click").c_str()));
-    cfg.paste = XKeysymToKeycode(
-        display, XStringToKeysym(config->get_string("paste").c_str()));
-    cfg.slow = XKeysymToKeycode(
-        display, XStringToKeysym(config->get_string("slow").c_str()));
+    cfg.trigger_sym = XStringToKeysym(config->get_string("trigger").c_str());
+
+    /* every keyword naming an action is a binding, e.g. "click" : "F,Return" */
+    std::vector<std::string> keywords = config->get_keywords();
+    for (size_t i = 0; i < keywords.size(); i++) {
+        action_type_t type;
+        int arg;
+        if (!Bindings::parse_action(keywords[i], type, arg)) {
+            continue;
+        }
+
+        std::stringstream names(config->get_string(keywords[i].c_str()));
+        std::string name;
+        while (std::getline(names, name, ',')) {
+            key_binding_t key = { XStringToKeysym(name.c_str()), type, arg,
+                                  keywords[i] };
+            if (NoSymbol == key.keysym) {
+                dbug(DEBUG_LEVEL_WARNING, DEBUG_TYPE_FRAMEWORK,
+                     "cannot bind " << name << " to " << keywords[i] <<
+                     ", unknown key");
+                continue;
+            }
+            cfg.keys.push_back(key);
+        }
+    }
+
     cfg.speed = config->get_int("speed");
     cfg.sleep = config->get_int("sleep");
+    std::string refresh = config->get_string("refresh");
+    cfg.refresh = ("auto" == refresh) ? REFRESH_AUTO : atof(refresh.c_str());
     cfg.numlock = config->get_bool("numlock") ? Mod2Mask : 0;
+    cfg.reactor = config->get_bool("reactor");
+    cfg.xinput2 = config->get_bool("xinput2");
+    cfg.evdev = config->get_string("evdev");
+    cfg.uinput = config->get_string("uinput");
+    if (cfg.uinput.empty()) {
+        cfg.uinput = "/dev/uinput";
+    }
+
+    /* "speed" pixels every "sleep" usec is the initial velocity */
+    double ticks = cfg.sleep > 0 ? 1e6 / cfg.sleep : 0.0;
+    cfg.motion.speed = cfg.speed * ticks;
+    cfg.motion.max_speed = config->get_float("max_speed");
+    cfg.motion.slow_speed = config->get_float("slow_speed");
+    if (cfg.motion.slow_speed <= 0.0) {
+        /* one pixel per tick, as it used to be */
+        cfg.motion.slow_speed = ticks;
+    }
+    cfg.motion.accel_time = config->get_float("accel_time") / 1000.0;
+    cfg.motion.curve = motion_parse_curve(config->get_string("accel"));
+
+    /* the wheels go in notches per second, with a curve of their own */
+    cfg.scroll.speed = config->get_float("scroll_speed");
+    if (cfg.scroll.speed <= 0.0) {
+        cfg.scroll.speed = 10.0;
+    }
+    cfg.scroll.max_speed = config->get_float("scroll_max_speed");
+    if (cfg.scroll.max_speed <= 0.0) {
+        cfg.scroll.max_speed = 4 * cfg.scroll.speed;
+    }
+    cfg.scroll.slow_speed = cfg.scroll.speed / 2;
+    cfg.scroll.accel_time = cfg.motion.accel_time;
+    std::string scroll_accel = config->get_string("scroll_accel");
+    cfg.scroll.curve = scroll_accel.empty() ? ACCEL_LINEAR :
+                       motion_parse_curve(scroll_accel);
+
+    cfg.edges = monitors_parse_edge_mode(config->get_string("edges"));
+    cfg.relative = config->get_bool("relative");
+    cfg.realtime.policy = realtime_parse_policy(config->get_string("realtime"));
+    cfg.realtime.priority = config->get_int("priority");
+    cfg.realtime.cpu = config->get_string("cpu").empty() ? -1 :
+                       config->get_int("cpu");
+
+    /* the displays to drive, the one in $DISPLAY if there is none */
+    std::stringstream displays(config->get_string("displays"));
+    std::string display_name;
+    while (std::getline(displays, display_name, ',')) {
+        if (!display_name.empty()) {
+            cfg.displays.push_back(display_name);
+        }
+    }
+    cfg.control = config->get_string("control");
 
     delete config;
     return cfg;
 }
 
+/**
+ * Parse a whole decimal number within [min, max], false if it is not one
+ */
+static bool
+parse_number (const std::string &text, long min, long max, int &value)
+{
+    char *end;
+    errno = 0;
+    long number = strtol(text.c_str(), &end, 10);
+    if (text.empty() || *end || errno || (number < min) || (number > max)) {
+        return false;
+    }
+    value = (int)number;
+    return true;
+}
+
+/**
+ * Apply the real-time settings given on the command line, if any
+ *
+ * The numbers have been checked by main() already.
+ */
+static void
+override_realtime (config_t &cfg, const std::string &policy,
+                   const std::string &priority, const std::string &cpu)
+{
+    if (!policy.empty()) {
+        cfg.realtime.policy = realtime_parse_policy(policy);
+    }
+    if (!priority.empty()) {
+        parse_number(priority, 0, INT_MAX, cfg.realtime.priority);
+    }
+    if (!cpu.empty()) {
+        parse_number(cpu, 0, CPU_SETSIZE - 1, cfg.realtime.cpu);
+    }
+}
+
+/**
+ * Publish a copy of the config in the slot
+ *
+ * The previous config is dropped if it was not picked up.
+ */
+static void
+publish_config (std::atomic<config_t*> &slot, const config_t &cfg)
+{
+    delete slot.exchange(new config_t(cfg));
+}
+
+/**
+ * Config watcher thread
+ *
+ * Waits for the config file to be written (or replaced) with inotify, parses
+ * it, and hands the result over to the loop: through fresh_config if the arg
+ * is NULL (evdev), or through the slot of every session in the vector the arg
+ * points to. The file is parsed once, without X: keymaps differ from display
+ * to display, so each session resolves the keysyms with its own Keymap when it
+ * picks the config up.
+ */
+void*
+config_thread (void *arg)
+{
+    std::vector<session_t*> *sessions = (std::vector<session_t*>*)arg;
+
+    pthread_setname_np(pthread_self(), "config watcher");
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+
+    /* editors often replace the file, so the directory is watched */
+    std::string::size_type slash = framework::config_file.rfind('/');
+    std::string dir = (std::string::npos == slash) ? "." :
+                      framework::config_file.substr(0, slash + 1);
+    std::string name = framework::config_file.substr(slash + 1);
+
+    int fd = inotify_init1(IN_CLOEXEC);
+    if ((fd < 0) ||
+        (inotify_add_watch(fd, dir.c_str(),
+                           IN_CLOSE_WRITE | IN_MOVED_TO) < 0)) {
+        dbug(DEBUG_LEVEL_WARNING, DEBUG_TYPE_FRAMEWORK,
+             "cannot watch " << dir << ": " << strerror(errno));
+        pthread_exit(NULL);
+    }
+
+    while (true) {
+        char buffer[4096]
+            __attribute__((aligned(__alignof__(struct inotify_event))));
+        ssize_t length = read(fd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            if ((length < 0) && (EINTR == errno)) {
+                continue;
+            }
+            break;
+        }
+
+        /* look for our file among the changed ones */
+        bool changed = false;
+        for (char *ptr = buffer; ptr < buffer + length;
+             ptr += sizeof(struct inotify_event) +
+                    ((struct inotify_event*)ptr)->len) {
+            struct inotify_event *event = (struct inotify_event*)ptr;
+            if (event->len && (name == event->name)) {
+                changed = true;
+            }
+        }
+        if (!changed) {
+            continue;
+        }
+
+        config_t cfg;
+        try {
+            cfg = parse_config();
+        } catch (return_code_en rc) {
+            dbug(DEBUG_LEVEL_ERROR, DEBUG_TYPE_FRAMEWORK,
+                 "could not reload config, error " << rc);
+            continue;
+        }
+        if (!sessions) {
+            publish_config(fresh_config, cfg);
+        } else {
+            for (size_t i = 0; i < sessions->size(); i++) {
+                publish_config((*sessions)[i]->fresh, cfg);
+            }
+        }
+
+        /* one wake-up is enough for every session */
+        uint64_t one = 1;
+        if (write(reload_fd, &one, sizeof(one)) < 0) {
+            dbug(DEBUG_LEVEL_ERROR, DEBUG_TYPE_FRAMEWORK,
+                 "could not wake up the main loop: " << strerror(errno));
+        }
+    }
+
+    close(fd);
+    pthread_exit(NULL);
+}
+
+/**
+ * Open a display and set up a session on it, NULL if it cannot be opened
+ *
+ * An empty name stands for the display in $DISPLAY. The keys of the config are
+ * resolved with the keymap of the display.
+ */
+static session_t*
+open_session (const std::string &name)
+{
+    const char *display_name = name.empty() ? NULL : name.c_str();
+    Display *display = XOpenDisplay(display_name);
+    if (NULL == display) {
+        dbug(DEBUG_LEVEL_ERROR, DEBUG_TYPE_FRAMEWORK,
+             "cannot open display " << XDisplayName(display_name));
+        return NULL;
+    }
+
+    /* get root window */
+    session_t *s = new session_t();
+    s->name = DisplayString(display);
+    s->display = display;
+    s->root = XDefaultRootWindow(display);
+    s->timer_fd = -1;
+
+    /* parse configuration */
+    try {
+        s->cfg = parse_config();
+    } catch (return_code_en rc) {
+        XCloseDisplay(display);
+        delete s;
+        throw;
+    }
+    s->state.motion.configure(s->cfg.motion);
+    s->state.scroll.configure(s->cfg.scroll);
+    keyset_clear(s->pressed_keys);
+
+    /* all requests go through the backend selected at build time */
+    s->x = new Backend(display, s->root);
+    dbug(DEBUG_LEVEL_NORMAL, DEBUG_TYPE_FRAMEWORK,
+         "using " << s->x->name() << " backend on " << s->name);
+
+    /* disable keyboard auto-repeat */
+    XkbSetDetectableAutoRepeat(display, True, NULL);
+
+    /* keymap copy, the keys are resolved with it from now on */
+    s->keymap = new Keymap(display);
+    s->keymap->init();
+    resolve_keys(s->cfg, s->keymap);
+
+    /* we are listening on key events and on the top-level windows */
+    XSelectInput(display, s->root,
+                 KeyPressMask | KeyReleaseMask | SubstructureNotifyMask);
+
+    /* monitor layout, for keeping the mouse on the screen */
+    s->monitors = new Monitors(display, s->root);
+    s->monitors->init();
+
+    /* window geometry, for snapping the mouse to the windows */
+    s->windows = new Windows(display, s->root);
+    s->windows->init();
+
+    /* grab the menu key */
+    s->x->grab_keys(&s->cfg.trigger, 1, s->cfg.numlock);
+    s->x->flush();
+
+    /* raw XInput2 key events, if asked for and available */
+    s->raw = NULL;
+    if (s->cfg.xinput2) {
+        s->raw = new RawKeys(display, s->root);
+        if (!s->raw->init()) {
+            dbug(DEBUG_LEVEL_WARNING, DEBUG_TYPE_FRAMEWORK,
+                 "falling back to core key events");
+            delete s->raw;
+            s->raw = NULL;
+        }
+    }
+
+    return s;
+}
+
+/**
+ * Release the trigger and close the display of a session
+ */
+static void
+close_session (session_t *s)
+{
+    s->x->ungrab_keys(&s->cfg.trigger, 1, s->cfg.numlock);
+    s->x->flush();
+    delete s->raw;
+    delete s->keymap;
+    delete s->windows;
+    delete s->monitors;
+    delete s->x;
+    XCloseDisplay(s->display);
+    delete s->fresh.exchange(NULL);
+    delete s;
+}
+
 /**
  * Signal handler thread
  */
@@ -317,17 +2333,49 @@ signal_thread (void *arg)
             break;
         }
 
-        /* catch CTRL-C */
+        /*
+         * Catch CTRL-C: the loop is woken up and stops, then the main thread
+         * cleans up, the recording included, so nothing is written to while
+         * it is being flushed
+         */
         if (SIGINT == signal) {
             dbug(DEBUG_LEVEL_NORMAL, DEBUG_TYPE_FRAMEWORK,
                  "SIGINT received, exiting");
-            exit(0);
+            quit.store(true);
+            uint64_t one = 1;
+            if ((reload_fd < 0) ||
+                (write(reload_fd, &one, sizeof(one)) < 0)) {
+                exit(0);
+            }
+        }
+
+        /* the statistics are read and reset while the main loop runs on */
+        if (SIGUSR1 == signal) {
+            stats_dump(stats);
+        } else if (SIGUSR2 == signal) {
+            stats_reset(stats);
+            dbug(DEBUG_LEVEL_NORMAL, DEBUG_TYPE_FRAMEWORK,
+                 "statistics reset");
         }
     }
 
     pthread_exit(NULL);
 }
 
+/**
+ * Write out what is left of the log and put cout back, returns rc
+ */
+static int
+finish_log (std::ofstream &logfile, std::streambuf *cout, int rc)
+{
+    framework::log_stop();
+    if (logfile.is_open()) {
+        std::cout.rdbuf(cout);
+        logfile.close();
+    }
+    return rc;
+}
+
 /**
  * Main function
  */
@@ -339,6 +2387,16 @@ main (int argc, char *argv[])
     std::ofstream logfile;
     std::string logfile_name;
     bool log_to_file = false;
+    std::string record_file;
+    std::string replay_file;
+    double sim_seconds = 0.0;
+    std::string rt_policy;
+    std::string rt_priority;
+    std::string rt_cpu;
+    std::vector<std::string> display_names;
+
+    /* whatever is still in the log ring gets written out on exit */
+    atexit(framework::log_stop);
 
     /* process command line arguments */
     for (int i = 1; i < argc; i++) {
@@ -366,6 +2424,53 @@ main (int argc, char *argv[])
         if ("-s" == arg) {
             framework::log_to_syslog = true;
         }
+
+        /* session recording and replay */
+        if ("-r" == arg) {
+            record_file = argv[++i];
+        }
+        if ("-R" == arg) {
+            replay_file = argv[++i];
+        }
+
+        /* headless simulation */
+        if ("-S" == arg) {
+            sim_seconds = atof(argv[++i]);
+        }
+
+        /* real-time mode, overriding the config */
+        if ("-P" == arg) {
+            rt_policy = argv[++i];
+        }
+        if ("-p" == arg) {
+            rt_priority = argv[++i];
+        }
+        if ("-a" == arg) {
+            rt_cpu = argv[++i];
+        }
+
+        /* displays to drive, overriding the config */
+        if ("-d" == arg) {
+            std::stringstream names(argv[++i]);
+            std::string name;
+            while (std::getline(names, name, ',')) {
+                display_names.push_back(name);
+            }
+        }
+    }
+
+    /* reject the real-time numbers that are not numbers */
+    int number;
+    if (!rt_priority.empty() &&
+        !parse_number(rt_priority, 0, INT_MAX, number)) {
+        dbug(DEBUG_LEVEL_ERROR, DEBUG_TYPE_FRAMEWORK,
+             "invalid priority " << rt_priority << " for -p");
+        return RC_MAIN_USAGE_ERROR;
+    }
+    if (!rt_cpu.empty() && !parse_number(rt_cpu, 0, CPU_SETSIZE - 1, number)) {
+        dbug(DEBUG_LEVEL_ERROR, DEBUG_TYPE_FRAMEWORK,
+             "invalid CPU " << rt_cpu << " for -a");
+        return RC_MAIN_USAGE_ERROR;
     }
 
     if (framework::log_to_syslog) {
@@ -392,6 +2497,25 @@ main (int argc, char *argv[])
         dbug(DEBUG_LEVEL_WARNING, DEBUG_TYPE_FRAMEWORK,
              "very verbose mode enabled!");
     }
+    /* a replay needs nothing but the trace, a simulation only the config */
+    if (!replay_file.empty() || (sim_seconds > 0.0)) {
+        /* nothing waits for signals here, the logger can start right away */
+        framework::log_start();
+        int rc;
+        if (!replay_file.empty()) {
+            rc = replay(replay_file);
+        } else {
+            try {
+                config_t cfg = parse_config();
+                resolve_keys(cfg, NULL);
+                rc = simulate(cfg, sim_seconds);
+            } catch (return_code_en error) {
+                rc = error;
+            }
+        }
+        return finish_log(logfile, cout, rc);
+    }
+
     dbug(DEBUG_LEVEL_NORMAL, DEBUG_TYPE_FRAMEWORK,
          "using config file " << framework::config_file);
 
@@ -404,7 +2528,7 @@ main (int argc, char *argv[])
     if (pthread_sigmask(SIG_BLOCK, &sigset, NULL) != 0) {
         dbug(DEBUG_LEVEL_ERROR, DEBUG_TYPE_FRAMEWORK,
              "unable to set sigmask");
-        return RC_MAIN_SIGNAL_ERROR;
+        return finish_log(logfile, cout, RC_MAIN_SIGNAL_ERROR);
     }
 
     /* spawn a signal handler thread to catch asynchronous signals from the OS */
@@ -412,47 +2536,130 @@ main (int argc, char *argv[])
     if (pthread_create(&signal_thrd, 0, signal_thread, (void*)&sigset) != 0) {
         dbug(DEBUG_LEVEL_ERROR, DEBUG_TYPE_FRAMEWORK,
              "unable to start signal handler thread");
-        return RC_MAIN_SIGNAL_ERROR;
+        return finish_log(logfile, cout, RC_MAIN_SIGNAL_ERROR);
     }
 
-    /* open the display */
-    Display *display = XOpenDisplay(NULL);
-    if (NULL == display) {
-        dbug(DEBUG_LEVEL_ERROR, DEBUG_TYPE_FRAMEWORK,
-             "cannot open display");
-        return RC_MAIN_DISPLAY_ERROR;
+    /* log messages are written by their own thread from now on */
+    framework::log_start();
+
+    /* fresh configs are announced to the main loop through this */
+    reload_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    pthread_t config_thrd;
+
+    /* the evdev backend does not need X at all */
+    {
+        config_t cfg;
+        try {
+            cfg = parse_config();
+        } catch (return_code_en rc) {
+            return finish_log(logfile, cout, rc);
+        }
+        override_realtime(cfg, rt_policy, rt_priority, rt_cpu);
+        if (display_names.empty()) {
+            display_names = cfg.displays;
+        }
+        if (!cfg.evdev.empty()) {
+            resolve_keys(cfg, NULL);
+            Evdev ev(cfg.evdev, cfg.uinput);
+            if (!ev.open()) {
+                return finish_log(logfile, cout, RC_MAIN_DEVICE_ERROR);
+            }
+            pthread_create(&config_thrd, 0, config_thread, NULL);
+            realtime_enter(cfg.realtime);
+            evdev_loop(ev, cfg);
+            pthread_cancel(config_thrd);
+            pthread_join(config_thrd, NULL);
+            pthread_cancel(signal_thrd);
+            pthread_join(signal_thrd, NULL);
+            return finish_log(logfile, cout, 0);
+        }
     }
 
-    /* get root window */
-    Window root = XDefaultRootWindow(display);
+    /* open the displays, and set up a session on each */
+    std::vector<session_t*> sessions;
+    if (display_names.empty()) {
+        display_names.push_back("");
+    }
+    for (size_t i = 0; i < display_names.size(); i++) {
+        session_t *s;
+        try {
+            s = open_session(display_names[i]);
+        } catch (return_code_en rc) {
+            return finish_log(logfile, cout, rc);
+        }
+        if (s) {
+            override_realtime(s->cfg, rt_policy, rt_priority, rt_cpu);
+            sessions.push_back(s);
+        }
+    }
+    if (sessions.empty()) {
+        return finish_log(logfile, cout, RC_MAIN_DISPLAY_ERROR);
+    }
+    session_t &first = *sessions[0];
 
-    /* parse configuration */
-    config_t cfg = parse_config(display);
+    /* start recording, the trace begins with everything a replay needs */
+    if (!record_file.empty() && (sessions.size() > 1)) {
+        dbug(DEBUG_LEVEL_WARNING, DEBUG_TYPE_FRAMEWORK,
+             "a trace holds a single display, not recording");
+    } else if (!record_file.empty() && !first.cfg.control.empty()) {
+        dbug(DEBUG_LEVEL_WARNING, DEBUG_TYPE_FRAMEWORK,
+             "a trace cannot hold control requests, not recording");
+    } else if (!record_file.empty()) {
+        recorder = new TraceWriter();
+        if (!recorder->open(record_file)) {
+            delete recorder;
+            recorder = NULL;
+        } else {
+            trace_loop_t loop = first.raw ? TRACE_LOOP_RAW :
+                                first.cfg.reactor ? TRACE_LOOP_REACTOR :
+                                TRACE_LOOP_POLLING;
+            recorder->write(TRACE_MAGIC, TRACE_HEADER, TRACE_VERSION, loop);
+            record_config(first.cfg);
+            record_layout(*first.monitors);
+            recorder->flush();
+            dbug(DEBUG_LEVEL_NORMAL, DEBUG_TYPE_FRAMEWORK,
+                 "recording to " << record_file);
+        }
+    }
 
-    /* disable keyboard auto-repeat */
-    XkbSetDetectableAutoRepeat(display, True, NULL);
+    /* scripts drive the pointer through the control socket, if there is one */
+    if (!first.cfg.control.empty()) {
+        control = new Control(first.cfg.control);
+        if (!control->open()) {
+            delete control;
+            control = NULL;
+        }
+    }
 
-    /* we are listening on key events */
-    XSelectInput(display, root, KeyPressMask | KeyReleaseMask);
+    /* watch the config file for changes */
+    pthread_create(&config_thrd, 0, config_thread, (void*)&sessions);
 
-    /* grab the menu key */
-    XGrabKey(display, cfg.trigger, cfg.numlock, root, False, GrabModeAsync,
-             GrabModeAsync);
+    /* only the loop runs in real-time mode, the helper threads are started */
+    realtime_enter(first.cfg.realtime);
 
-    /* loop forever */
-    main_loop(display, root, cfg);
+    /* loop forever, several displays and the control socket need the reactor */
+    if (first.cfg.reactor || first.raw || (sessions.size() > 1) || control) {
+        reactor_loop(sessions);
+    } else {
+        XSource input(first.display, first.x, first.monitors, first.windows,
+                      first.keymap, reload_fd);
+        main_loop(input, *first.x, *first.monitors, *first.windows,
+                  first.keymap, first.cfg, first.fresh);
+    }
 
     /* cleanup */
-    XUngrabKey(display, cfg.trigger, cfg.numlock, root);
-    XCloseDisplay(display);
+    pthread_cancel(config_thrd);
+    pthread_join(config_thrd, NULL);
+    for (size_t i = 0; i < sessions.size(); i++) {
+        close_session(sessions[i]);
+    }
+    delete control;
+    control = NULL;
+    delete recorder;
+    recorder = NULL;
     pthread_cancel(signal_thrd);
     pthread_join(signal_thrd, NULL);
 
     /* close logfile if we used one */
-    if (logfile.is_open()) {
-        std::cout.rdbuf(cout);
-        logfile.close();
-    }
-
-    return 0;
+    return finish_log(logfile, cout, 0);
 }
@@ -0,0 +1,354 @@
+/*
+ *------------------------------------------------------------------------------
+ *
+ * monitors.cc
+ *
+ * Monitor layout cache of project keymouse
+ *
+ * Copyright (c) 2017 Zoltan Toth <ztoth AT thetothfamily DOT net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *------------------------------------------------------------------------------
+ */
+#include <climits>
+#include <algorithm>
+#include <X11/extensions/Xrandr.h>
+
+#include "framework.h"
+#include "monitors.h"
+
+/**
+ * Get the refresh rate of a mode in Hz, 0 if it is not in the resources
+ */
+static double
+mode_rate (const XRRScreenResources *res, RRMode id)
+{
+    for (int i = 0; i < res->nmode; i++) {
+        const XRRModeInfo &mode = res->modes[i];
+        if ((mode.id != id) || !mode.hTotal || !mode.vTotal) {
+            continue;
+        }
+
+        double lines = mode.vTotal;
+        if (mode.modeFlags & RR_DoubleScan) {
+            lines *= 2;
+        }
+        if (mode.modeFlags & RR_Interlace) {
+            lines /= 2;
+        }
+        return (mode.dotClock / (mode.hTotal * lines));
+    }
+    return 0.0;
+}
+
+/**
+ * Constructor with the display and its root window
+ */
+Monitors::Monitors (Display *display, Window root)
+    : display(display), root(root), randr(false), event_base(0), rate(0.0)
+{
+    bounds.x = bounds.y = bounds.width = bounds.height = 0;
+}
+
+/**
+ * Monitors destructor
+ */
+Monitors::~Monitors (void)
+{
+    monitors.clear();
+}
+
+/**
+ * Select change notifications and build the cache
+ */
+void
+Monitors::init (void)
+{
+    int error_base;
+    randr = XRRQueryExtension(display, &event_base, &error_base);
+    if (randr) {
+        XRRSelectInput(display, root,
+                       RRScreenChangeNotifyMask | RRCrtcChangeNotifyMask);
+    } else {
+        dbug(DEBUG_LEVEL_WARNING, DEBUG_TYPE_FRAMEWORK,
+             "XRandR is not available, using the screen size");
+    }
+    refresh();
+}
+
+/**
+ * Refresh the cache if this is a change notification
+ */
+bool
+Monitors::handle_event (XEvent &event)
+{
+    if (!randr) {
+        return false;
+    }
+    if (event.type == event_base + RRScreenChangeNotify) {
+        /* let Xlib know about the new screen size as well */
+        XRRUpdateConfiguration(&event);
+    } else if (event.type != event_base + RRNotify) {
+        return false;
+    }
+
+    refresh();
+    return true;
+}
+
+/**
+ * Rebuild the cache from the server
+ */
+void
+Monitors::refresh (void)
+{
+    monitors.clear();
+    rate = 0.0;
+
+    if (randr) {
+        XRRScreenResources *res = XRRGetScreenResourcesCurrent(display, root);
+        for (int i = 0; res && (i < res->ncrtc); i++) {
+            XRRCrtcInfo *crtc = XRRGetCrtcInfo(display, res, res->crtcs[i]);
+            if (!crtc) {
+                continue;
+            }
+
+            /* disabled CRTCs have no mode */
+            if ((None != crtc->mode) && crtc->width && crtc->height) {
+                monitor_t monitor;
+                monitor.x = crtc->x;
+                monitor.y = crtc->y;
+                monitor.width = crtc->width;
+                monitor.height = crtc->height;
+                monitors.push_back(monitor);
+                rate = std::max(rate, mode_rate(res, crtc->mode));
+            }
+            XRRFreeCrtcInfo(crtc);
+        }
+        if (res) {
+            XRRFreeScreenResources(res);
+        }
+    }
+
+    /* fall back to the whole screen */
+    if (monitors.empty()) {
+        monitor_t monitor;
+        monitor.x = 0;
+        monitor.y = 0;
+        monitor.width = DisplayWidth(display, DefaultScreen(display));
+        monitor.height = DisplayHeight(display, DefaultScreen(display));
+        monitors.push_back(monitor);
+    }
+
+    update_bounds();
+    dbug(DEBUG_LEVEL_VERBOSE, DEBUG_TYPE_FRAMEWORK,
+         "fastest refresh rate: " << rate << " Hz");
+}
+
+/**
+ * Recompute the bounding box of the monitors, used for wrapping around
+ */
+void
+Monitors::update_bounds (void)
+{
+    int x0 = INT_MAX, y0 = INT_MAX, x1 = INT_MIN, y1 = INT_MIN;
+    for (size_t i = 0; i < monitors.size(); i++) {
+        const monitor_t &m = monitors[i];
+        x0 = std::min(x0, m.x);
+        y0 = std::min(y0, m.y);
+        x1 = std::max(x1, m.x + m.width);
+        y1 = std::max(y1, m.y + m.height);
+
+        dbug(DEBUG_LEVEL_VERBOSE, DEBUG_TYPE_FRAMEWORK,
+             "monitor " << i << ": " << m.width << "x" << m.height << "+" <<
+             m.x << "+" << m.y);
+    }
+    bounds.x = x0;
+    bounds.y = y0;
+    bounds.width = x1 - x0;
+    bounds.height = y1 - y0;
+}
+
+/**
+ * Index of the monitor containing the point
+ */
+int
+Monitors::find (int x, int y) const
+{
+    for (size_t i = 0; i < monitors.size(); i++) {
+        const monitor_t &m = monitors[i];
+        if ((x >= m.x) && (x < m.x + m.width) &&
+            (y >= m.y) && (y < m.y + m.height)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Index of the monitor closest to the point, moving the point onto it
+ *
+ * If a direction is given, only the monitors that lie (at least partly) in
+ * that direction are considered.
+ */
+int
+Monitors::nearest (int &x, int &y, int dir_x, int dir_y) const
+{
+    int best = -1;
+    long best_distance = LONG_MAX;
+    int best_x = x, best_y = y;
+
+    for (size_t i = 0; i < monitors.size(); i++) {
+        const monitor_t &m = monitors[i];
+        if (((dir_x > 0) && (m.x + m.width <= x)) ||
+            ((dir_x < 0) && (m.x > x)) ||
+            ((dir_y > 0) && (m.y + m.height <= y)) ||
+            ((dir_y < 0) && (m.y > y))) {
+            continue;
+        }
+
+        int cx = std::max(m.x, std::min(x, m.x + m.width - 1));
+        int cy = std::max(m.y, std::min(y, m.y + m.height - 1));
+        long distance = (long)(cx - x) * (cx - x) + (long)(cy - y) * (cy - y);
+        if (distance < best_distance) {
+            best = i;
+            best_distance = distance;
+            best_x = cx;
+            best_y = cy;
+        }
+    }
+
+    x = best_x;
+    y = best_y;
+    return best;
+}
+
+/**
+ * Limit a move to the monitors
+ *
+ * Moving from one monitor straight onto a neighbouring one is always allowed.
+ * Otherwise the pointer stops at the edge (clamp), comes back on the other side
+ * of the layout (wrap), or goes on to the next monitor in the direction of the
+ * movement, skipping the dead space in between (jump).
+ */
+void
+Monitors::limit (int from_x, int from_y, int &x, int &y, edge_mode_t mode) const
+{
+    if (find(x, y) >= 0) {
+        return;
+    }
+
+    int dir_x = (x > from_x) - (x < from_x);
+    int dir_y = (y > from_y) - (y < from_y);
+
+    switch (mode) {
+    case EDGE_WRAP:
+        if (x < bounds.x) {
+            x += bounds.width;
+        } else if (x >= bounds.x + bounds.width) {
+            x -= bounds.width;
+        }
+        if (y < bounds.y) {
+            y += bounds.height;
+        } else if (y >= bounds.y + bounds.height) {
+            y -= bounds.height;
+        }
+        nearest(x, y, 0, 0);
+        break;
+    case EDGE_JUMP:
+        if (nearest(x, y, dir_x, dir_y) >= 0) {
+            break;
+        }
+        /* nothing in that direction, stop at the edge */
+        /* fall through */
+    case EDGE_CLAMP:
+    default:
+        {
+            /* stay on the monitor we came from */
+            int index = find(from_x, from_y);
+            if (index < 0) {
+                nearest(x, y, 0, 0);
+                break;
+            }
+            const monitor_t &m = monitors[index];
+            x = std::max(m.x, std::min(x, m.x + m.width - 1));
+            y = std::max(m.y, std::min(y, m.y + m.height - 1));
+        }
+        break;
+    }
+}
+
+/**
+ * Number of monitors in the cache
+ */
+int
+Monitors::count (void) const
+{
+    return monitors.size();
+}
+
+/**
+ * The cached layout
+ */
+const std::vector<monitor_t>&
+Monitors::layout (void) const
+{
+    return monitors;
+}
+
+/**
+ * The monitor containing the point, the bounding box of all if there is none
+ */
+const monitor_t&
+Monitors::at (int x, int y) const
+{
+    int index = find(x, y);
+    return (index >= 0) ? monitors[index] : bounds;
+}
+
+/**
+ * Refresh rate of the fastest monitor in Hz, 0 if unknown
+ */
+double
+Monitors::refresh_rate (void) const
+{
+    return rate;
+}
+
+/**
+ * Replace the cached layout
+ *
+ * Change notifications from the server rebuild the cache as usual.
+ */
+void
+Monitors::set_layout (const std::vector<monitor_t> &layout)
+{
+    monitors = layout;
+    update_bounds();
+}
+
+/**
+ * Parse the name of an edge mode
+ */
+edge_mode_t
+monitors_parse_edge_mode (const std::string &name)
+{
+    if ("wrap" == name) {
+        return EDGE_WRAP;
+    } else if ("jump" == name) {
+        return EDGE_JUMP;
+    }
+    return EDGE_CLAMP;
+}
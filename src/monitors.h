@@ -0,0 +1,113 @@
+/*
+ *------------------------------------------------------------------------------
+ *
+ * monitors.h
+ *
+ * Monitor layout cache of project keymouse
+ *
+ * Copyright (c) 2017 Zoltan Toth <ztoth AT thetothfamily DOT net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *------------------------------------------------------------------------------
+ */
+#ifndef MONITORS_H_
+#define MONITORS_H_
+
+#include <string>
+#include <vector>
+#include <X11/Xlib.h>
+
+/** what happens when the pointer would leave the monitors */
+typedef enum edge_mode_e {
+    EDGE_CLAMP,
+    EDGE_WRAP,
+    EDGE_JUMP
+} edge_mode_t;
+
+/** monitor geometry in root window coordinates */
+typedef struct monitor_s {
+    int x;
+    int y;
+    int width;
+    int height;
+} monitor_t;
+
+/**
+ * Monitors class
+ *
+ * Client-side cache of the monitor layout, built from the XRandR CRTC geometry.
+ * The cache is refreshed only when the server sends a screen or CRTC change
+ * notification, so limiting the pointer movement costs no requests at all.
+ * Without XRandR the whole screen is treated as a single monitor, with an
+ * unknown refresh rate.
+ */
+class Monitors {
+  public:
+    /** constructor, pass the opened display and its root window */
+    Monitors (Display *display, Window root);
+
+    /** default destructor */
+    virtual ~Monitors (void);
+
+    /** select change notifications and build the cache */
+    void init (void);
+
+    /** refresh the cache if this is a change notification, false otherwise */
+    bool handle_event (XEvent &event);
+
+    /** limit a move from (from_x, from_y) to (x, y) to the monitors */
+    void limit (int from_x, int from_y, int &x, int &y, edge_mode_t mode) const;
+
+    /** number of monitors in the cache */
+    int count (void) const;
+
+    /** the cached layout */
+    const std::vector<monitor_t>& layout (void) const;
+
+    /** the monitor containing the point, the bounding box if there is none */
+    const monitor_t& at (int x, int y) const;
+
+    /** refresh rate of the fastest monitor in Hz, 0 if unknown */
+    double refresh_rate (void) const;
+
+    /** replace the cached layout, e.g. with a recorded one */
+    void set_layout (const std::vector<monitor_t> &layout);
+
+  private:
+    Display *display;                             /** X display connection */
+    Window root;                                  /** root window */
+    bool randr;                                   /** XRandR is available */
+    int event_base;                               /** first XRandR event */
+    std::vector<monitor_t> monitors;              /** cached layout */
+    monitor_t bounds;                             /** bounding box of all */
+    double rate;                                  /** fastest refresh rate */
+
+    /** rebuild the cache from the server */
+    void refresh (void);
+
+    /** recompute the bounding box of the monitors */
+    void update_bounds (void);
+
+    /** index of the monitor containing the point, -1 if none */
+    int find (int x, int y) const;
+
+    /** index of the monitor closest to the point, moving it onto it */
+    int nearest (int &x, int &y, int dir_x, int dir_y) const;
+};
+
+/** parse the name of an edge mode, EDGE_CLAMP if unknown */
+edge_mode_t monitors_parse_edge_mode (const std::string &name);
+
+#endif /* MONITORS_H_ */
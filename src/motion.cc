@@ -0,0 +1,171 @@
+/*
+ *------------------------------------------------------------------------------
+ *
+ * motion.cc
+ *
+ * Pointer motion engine of project keymouse
+ *
+ * Copyright (c) 2017 Zoltan Toth <ztoth AT thetothfamily DOT net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *------------------------------------------------------------------------------
+ */
+#include <cmath>
+#include <algorithm>
+
+#include "motion.h"
+
+/**
+ * Constructor
+ */
+Motion::Motion (void)
+    : active(false), start(0), last(0), rem_x(0.0), rem_y(0.0)
+{
+    config.speed = 0.0;
+    config.max_speed = 0.0;
+    config.slow_speed = 0.0;
+    config.accel_time = 0.0;
+    config.curve = ACCEL_NONE;
+}
+
+/**
+ * Motion destructor
+ */
+Motion::~Motion (void)
+{
+}
+
+/**
+ * Set the velocity curve
+ */
+void
+Motion::configure (const motion_config_t &config)
+{
+    this->config = config;
+
+    /* a curve needs somewhere to go and some time to get there */
+    if ((this->config.max_speed <= this->config.speed) ||
+        (this->config.accel_time <= 0.0)) {
+        this->config.curve = ACCEL_NONE;
+    }
+}
+
+/**
+ * Get the pixels to move since the last step
+ *
+ * The first step of a movement moves one pixel in the requested direction(s),
+ * so a short tap always nudges the pointer, regardless of the tick rate.
+ */
+void
+Motion::step (int dir_x, int dir_y, gear_t gear, uint64_t now, int &dx,
+              int &dy)
+{
+    dx = 0;
+    dy = 0;
+
+    if (!dir_x && !dir_y) {
+        stop();
+        return;
+    }
+
+    if (!active) {
+        active = true;
+        start = now;
+        last = now;
+        rem_x = dir_x;
+        rem_y = dir_y;
+    } else if (now > last) {
+        /* distance covered by the curve since the last step */
+        double t0 = (last - start) / 1e9;
+        double t1 = (now - start) / 1e9;
+        double d;
+        if (GEAR_SLOW == gear) {
+            d = config.slow_speed * (t1 - t0);
+        } else if (GEAR_FAST == gear) {
+            d = std::max(config.speed, config.max_speed) * (t1 - t0);
+        } else {
+            d = distance(t1) - distance(t0);
+        }
+        last = now;
+
+        /* an axis that stopped moving loses its remainder */
+        rem_x = dir_x ? rem_x + dir_x * d : 0.0;
+        rem_y = dir_y ? rem_y + dir_y * d : 0.0;
+    }
+
+    /* move the whole pixels, keep the fractions for later */
+    dx = (int)rem_x;
+    dy = (int)rem_y;
+    rem_x -= dx;
+    rem_y -= dy;
+}
+
+/**
+ * Forget the current movement
+ */
+void
+Motion::stop (void)
+{
+    active = false;
+    rem_x = 0.0;
+    rem_y = 0.0;
+}
+
+/**
+ * True while a movement is in progress
+ */
+bool
+Motion::moving (void) const
+{
+    return active;
+}
+
+/**
+ * Distance travelled t seconds into the movement, the integral of v(t)
+ */
+double
+Motion::distance (double t) const
+{
+    double v0 = config.speed;
+    double v1 = config.max_speed;
+    double ramp = config.accel_time;
+
+    switch (config.curve) {
+    case ACCEL_LINEAR:
+        if (t < ramp) {
+            return (v0 * t + (v1 - v0) * t * t / (2 * ramp));
+        }
+        return ((v0 + v1) * ramp / 2 + v1 * (t - ramp));
+    case ACCEL_EXPONENTIAL:
+        return (v1 * t - (v1 - v0) * ramp * (1 - exp(-t / ramp)));
+    case ACCEL_NONE:
+    default:
+        return (v0 * t);
+    }
+}
+
+/**
+ * Parse the name of an acceleration curve
+ */
+accel_curve_t
+motion_parse_curve (const std::string &name)
+{
+    if ("linear" == name) {
+        return ACCEL_LINEAR;
+    } else if ("exponential" == name) {
+        return ACCEL_EXPONENTIAL;
+    }
+    return ACCEL_NONE;
+}
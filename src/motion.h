@@ -0,0 +1,108 @@
+/*
+ *------------------------------------------------------------------------------
+ *
+ * motion.h
+ *
+ * Pointer motion engine of project keymouse
+ *
+ * Copyright (c) 2017 Zoltan Toth <ztoth AT thetothfamily DOT net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *------------------------------------------------------------------------------
+ */
+#ifndef MOTION_H_
+#define MOTION_H_
+
+#include <stdint.h>
+#include <string>
+
+/** acceleration curves */
+typedef enum accel_curve_e {
+    ACCEL_NONE,
+    ACCEL_LINEAR,
+    ACCEL_EXPONENTIAL
+} accel_curve_t;
+
+/** speed gears */
+typedef enum gear_e {
+    GEAR_NORMAL,
+    GEAR_SLOW,
+    GEAR_FAST
+} gear_t;
+
+/** motion configuration, velocities are in pixels per second */
+typedef struct motion_config_s {
+    double speed;                                 /** initial velocity */
+    double max_speed;                             /** top velocity */
+    double slow_speed;                            /** velocity in slow gear */
+    double accel_time;                            /** ramp time in seconds */
+    accel_curve_t curve;                          /** acceleration curve */
+} motion_config_t;
+
+/**
+ * Motion class
+ *
+ * Time-based pointer motion integrator. The distance travelled between two
+ * steps is taken from the closed form of the velocity curve, using monotonic
+ * timestamps, and the sub-pixel remainders are carried over to the next step.
+ * This way the pointer speed does not depend on how often (or how regularly)
+ * step() is called.
+ *
+ * The curves of the normal gear, with t being the time since the movement
+ * started:
+ *   - none:        v(t) = speed
+ *   - linear:      v(t) = speed + (max_speed - speed) * min(t / accel_time, 1)
+ *   - exponential: v(t) = max_speed - (max_speed - speed) * e^(-t / accel_time)
+ *
+ * The slow gear moves at slow_speed, the fast one at max_speed, without any
+ * acceleration.
+ */
+class Motion {
+  public:
+    /** constructor */
+    Motion (void);
+
+    /** default destructor */
+    virtual ~Motion (void);
+
+    /** set the velocity curve */
+    void configure (const motion_config_t &config);
+
+    /** get the pixels to move since the last step, now is in nanoseconds */
+    void step (int dir_x, int dir_y, gear_t gear, uint64_t now, int &dx,
+               int &dy);
+
+    /** forget the current movement, the next step starts a new one */
+    void stop (void);
+
+    /** true while a movement is in progress */
+    bool moving (void) const;
+
+  private:
+    motion_config_t config;                       /** velocity curve */
+    bool active;                                  /** movement in progress */
+    uint64_t start;                               /** movement start time */
+    uint64_t last;                                /** time of the last step */
+    double rem_x;                                 /** horizontal remainder */
+    double rem_y;                                 /** vertical remainder */
+
+    /** distance travelled t seconds into the movement at full speed */
+    double distance (double t) const;
+};
+
+/** parse the name of an acceleration curve, ACCEL_NONE if unknown */
+accel_curve_t motion_parse_curve (const std::string &name);
+
+#endif /* MOTION_H_ */
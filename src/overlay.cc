@@ -0,0 +1,118 @@
+/*
+ *------------------------------------------------------------------------------
+ *
+ * overlay.cc
+ *
+ * Grid overlay of project keymouse
+ *
+ * Copyright (c) 2017 Zoltan Toth <ztoth AT thetothfamily DOT net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *------------------------------------------------------------------------------
+ */
+#include <algorithm>
+
+#include "overlay.h"
+
+/**
+ * Constructor with the display and its root window
+ */
+Overlay::Overlay (Display *display, Window root)
+    : display(display), root(root), mapped(false)
+{
+    for (int i = 0; i < OVERLAY_BARS; i++) {
+        bars[i] = None;
+    }
+}
+
+/**
+ * Overlay destructor
+ */
+Overlay::~Overlay (void)
+{
+    for (int i = 0; i < OVERLAY_BARS; i++) {
+        if (None != bars[i]) {
+            XDestroyWindow(display, bars[i]);
+        }
+    }
+}
+
+/**
+ * Create the bar windows
+ *
+ * Allocating the color is the only request here that waits for a reply, and
+ * it is made only once.
+ */
+void
+Overlay::create (void)
+{
+    int screen = DefaultScreen(display);
+    XColor color, exact;
+    XSetWindowAttributes attributes;
+    attributes.override_redirect = True;
+    attributes.background_pixel = WhitePixel(display, screen);
+    if (XAllocNamedColor(display, DefaultColormap(display, screen),
+                         OVERLAY_COLOR, &color, &exact)) {
+        attributes.background_pixel = color.pixel;
+    }
+
+    for (int i = 0; i < OVERLAY_BARS; i++) {
+        bars[i] = XCreateWindow(display, root, 0, 0, 1, 1, 0, CopyFromParent,
+                                InputOutput, CopyFromParent,
+                                CWOverrideRedirect | CWBackPixel, &attributes);
+    }
+}
+
+/**
+ * Show the grid over the given rectangle, or move it there
+ */
+void
+Overlay::show (int x, int y, int width, int height)
+{
+    if (None == bars[0]) {
+        create();
+    }
+
+    /* the bars stay inside the rectangle, however small it gets */
+    int line = OVERLAY_LINE_WIDTH;
+    int w = std::max(width, line);
+    int h = std::max(height, line);
+    XMoveResizeWindow(display, bars[0], x, y, w, line);
+    XMoveResizeWindow(display, bars[1], x, y + h - line, w, line);
+    XMoveResizeWindow(display, bars[2], x, y, line, h);
+    XMoveResizeWindow(display, bars[3], x + w - line, y, line, h);
+    XMoveResizeWindow(display, bars[4], x + (w - line) / 2, y, line, h);
+    XMoveResizeWindow(display, bars[5], x, y + (h - line) / 2, w, line);
+
+    for (int i = 0; i < OVERLAY_BARS; i++) {
+        XMapRaised(display, bars[i]);
+    }
+    mapped = true;
+}
+
+/**
+ * Hide the grid
+ */
+void
+Overlay::hide (void)
+{
+    if (!mapped) {
+        return;
+    }
+    for (int i = 0; i < OVERLAY_BARS; i++) {
+        XUnmapWindow(display, bars[i]);
+    }
+    mapped = false;
+}
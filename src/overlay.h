@@ -0,0 +1,73 @@
+/*
+ *------------------------------------------------------------------------------
+ *
+ * overlay.h
+ *
+ * Grid overlay of project keymouse
+ *
+ * Copyright (c) 2017 Zoltan Toth <ztoth AT thetothfamily DOT net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *------------------------------------------------------------------------------
+ */
+#ifndef OVERLAY_H_
+#define OVERLAY_H_
+
+#include <X11/Xlib.h>
+
+/** number of bars drawing the grid: four edges and the two center lines */
+#define OVERLAY_BARS 6
+
+/** width of the bars in pixels */
+#define OVERLAY_LINE_WIDTH 2
+
+/** color of the bars */
+#define OVERLAY_COLOR "red"
+
+/**
+ * Overlay class
+ *
+ * Draws the navigation grid on top of everything: the edges of a rectangle
+ * and the lines cutting it in half. Each bar is a small override-redirect
+ * window with a solid background, so there is nothing to paint, no extension
+ * to depend on, and moving the grid is a handful of ConfigureWindow requests.
+ * The windows are created the first time the grid is shown. Nothing is
+ * flushed here, the requests go out with the next flush of the caller.
+ */
+class Overlay {
+  public:
+    /** constructor, pass the opened display and its root window */
+    Overlay (Display *display, Window root);
+
+    /** default destructor, destroys the windows */
+    virtual ~Overlay (void);
+
+    /** show the grid over the given rectangle, or move it there */
+    void show (int x, int y, int width, int height);
+
+    /** hide the grid */
+    void hide (void);
+
+  private:
+    Display *display;                             /** X display connection */
+    Window root;                                  /** root window */
+    Window bars[OVERLAY_BARS];                    /** None until created */
+    bool mapped;                                  /** the bars are shown */
+
+    /** create the bar windows */
+    void create (void);
+};
+
+#endif /* OVERLAY_H_ */
@@ -0,0 +1,142 @@
+/*
+ *------------------------------------------------------------------------------
+ *
+ * realtime.cc
+ *
+ * Real-time scheduling of project keymouse
+ *
+ * Copyright (c) 2017 Zoltan Toth <ztoth AT thetothfamily DOT net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *------------------------------------------------------------------------------
+ */
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "framework.h"
+#include "realtime.h"
+
+/**
+ * Touch every page of a large stack frame, so they are all mapped in
+ *
+ * With the memory locked the pages stay, and the loop never has to wait for
+ * the kernel to fault a fresh stack page in.
+ */
+static void __attribute__((noinline))
+prefault_stack (void)
+{
+    volatile unsigned char stack[REALTIME_STACK_PREFAULT];
+    for (size_t i = 0; i < sizeof(stack); i += 4096) {
+        stack[i] = 0;
+    }
+}
+
+#ifdef DEBUG
+/**
+ * Name of a scheduling policy, for the log
+ */
+static const char*
+policy_name (int policy)
+{
+    if (SCHED_FIFO == policy) {
+        return "SCHED_FIFO";
+    } else if (SCHED_RR == policy) {
+        return "SCHED_RR";
+    }
+    return "SCHED_OTHER";
+}
+#endif
+
+/**
+ * Put the calling thread in real-time mode, as far as privileges allow
+ */
+void
+realtime_enter (const realtime_config_t &config)
+{
+    if (config.cpu >= CPU_SETSIZE) {
+        dbug(DEBUG_LEVEL_WARNING, DEBUG_TYPE_FRAMEWORK,
+             "there is no CPU " << config.cpu << ", the loop runs on any CPU");
+    } else if (config.cpu >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(config.cpu, &cpus);
+        int rc = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if (rc) {
+            dbug(DEBUG_LEVEL_WARNING, DEBUG_TYPE_FRAMEWORK,
+                 "cannot pin the loop to CPU " << config.cpu << ": " <<
+                 strerror(rc) << ", it runs on any CPU");
+        } else {
+            dbug(DEBUG_LEVEL_NORMAL, DEBUG_TYPE_FRAMEWORK,
+                 "loop pinned to CPU " << config.cpu);
+        }
+    }
+
+    if (SCHED_OTHER == config.policy) {
+        return;
+    }
+
+    /* keep the priority within the range of the policy */
+    struct sched_param param = sched_param();
+    param.sched_priority = config.priority;
+    if (!param.sched_priority) {
+        param.sched_priority = REALTIME_DEFAULT_PRIORITY;
+    }
+    param.sched_priority = std::max(param.sched_priority,
+                                    sched_get_priority_min(config.policy));
+    param.sched_priority = std::min(param.sched_priority,
+                                    sched_get_priority_max(config.policy));
+
+    int rc = pthread_setschedparam(pthread_self(), config.policy, &param);
+    if (rc) {
+        dbug(DEBUG_LEVEL_WARNING, DEBUG_TYPE_FRAMEWORK,
+             "cannot switch to " << policy_name(config.policy) << ": " <<
+             strerror(rc) << " (needs CAP_SYS_NICE or an RLIMIT_RTPRIO of " <<
+             param.sched_priority << "), running at normal priority");
+    } else {
+        dbug(DEBUG_LEVEL_NORMAL, DEBUG_TYPE_FRAMEWORK,
+             "loop running at " << policy_name(config.policy) <<
+             " priority " << param.sched_priority);
+    }
+
+    /* a page fault can take longer than a whole tick */
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+        dbug(DEBUG_LEVEL_WARNING, DEBUG_TYPE_FRAMEWORK,
+             "cannot lock memory: " << strerror(errno) <<
+             " (needs CAP_IPC_LOCK or a larger RLIMIT_MEMLOCK), pages may be"
+             " swapped out");
+    } else {
+        dbug(DEBUG_LEVEL_NORMAL, DEBUG_TYPE_FRAMEWORK,
+             "memory locked");
+    }
+    prefault_stack();
+}
+
+/**
+ * Parse the name of a scheduling policy
+ */
+int
+realtime_parse_policy (const std::string &name)
+{
+    if ("fifo" == name) {
+        return SCHED_FIFO;
+    } else if ("rr" == name) {
+        return SCHED_RR;
+    }
+    return SCHED_OTHER;
+}
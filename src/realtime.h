@@ -0,0 +1,58 @@
+/*
+ *------------------------------------------------------------------------------
+ *
+ * realtime.h
+ *
+ * Real-time scheduling of project keymouse
+ *
+ * Copyright (c) 2017 Zoltan Toth <ztoth AT thetothfamily DOT net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *------------------------------------------------------------------------------
+ */
+#ifndef REALTIME_H_
+#define REALTIME_H_
+
+#include <string>
+
+/** static priority of the real-time policies if none is configured */
+#define REALTIME_DEFAULT_PRIORITY 10
+
+/** bytes of stack touched in advance, so the loop never faults on it */
+#define REALTIME_STACK_PREFAULT (256 * 1024)
+
+/** real-time settings of the thread running the loop */
+typedef struct realtime_config_s {
+    int policy;                                   /** SCHED_FIFO, SCHED_RR or
+                                                      SCHED_OTHER (off) */
+    int priority;                                 /** static priority */
+    int cpu;                                      /** CPU to pin to, -1: any */
+} realtime_config_t;
+
+/**
+ * Put the calling thread in real-time mode, as far as privileges allow
+ *
+ * With a real-time policy the thread is switched to it, the whole process is
+ * locked in memory and the stack is prefaulted; the thread is pinned to the
+ * CPU if there is one. Every step that fails is logged and skipped, the loop
+ * runs on either way. Threads created afterwards inherit the policy, so this
+ * should come after the helper threads have been started.
+ */
+void realtime_enter (const realtime_config_t &config);
+
+/** parse the name of a policy (fifo or rr), SCHED_OTHER if unknown */
+int realtime_parse_policy (const std::string &name);
+
+#endif /* REALTIME_H_ */
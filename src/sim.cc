@@ -0,0 +1,320 @@
+/*
+ *------------------------------------------------------------------------------
+ *
+ * sim.cc
+ *
+ * Headless simulation backend of project keymouse
+ *
+ * Copyright (c) 2017 Zoltan Toth <ztoth AT thetothfamily DOT net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *------------------------------------------------------------------------------
+ */
+#include <algorithm>
+#include <cstdlib>
+
+#include "sim.h"
+
+/** how long the scripted keys are held and released, in nsec */
+#define SIM_MOVE_HOLD   300000000ULL
+#define SIM_BUTTON_HOLD  30000000ULL
+#define SIM_GAP          50000000ULL
+
+/**
+ * Order of the scripted transitions
+ */
+static bool
+sim_key_before (const sim_key_t &a, const sim_key_t &b)
+{
+    return a.time < b.time;
+}
+
+/**
+ * Constructor with the end of the input
+ */
+SimInput::SimInput (uint64_t end)
+    : clock(0), end(end), sorted(true), delivered(0), applied(0)
+{
+    keyset_clear(held);
+}
+
+/**
+ * SimInput destructor
+ */
+SimInput::~SimInput (void)
+{
+    script.clear();
+}
+
+/**
+ * Add a key transition
+ */
+void
+SimInput::script_key (uint64_t time, unsigned int code, bool pressed)
+{
+    sim_key_t key;
+    key.time = time;
+    key.code = code;
+    key.pressed = pressed;
+    script.push_back(key);
+    sorted = false;
+}
+
+/**
+ * Script a session
+ *
+ * The trigger is pressed first, then the bound keys are pressed one after the
+ * other, over and over: direction and scroll keys are held long enough to
+ * accelerate, the others are tapped.
+ */
+void
+SimInput::script_session (unsigned int trigger, const Bindings &bindings)
+{
+    uint64_t time = SIM_GAP;
+    script_key(time, trigger, true);
+    script_key(time + SIM_BUTTON_HOLD, trigger, false);
+    time += SIM_BUTTON_HOLD + SIM_GAP;
+
+    keyset_t keys = bindings.keys();
+    if (!keyset_any(keys, keys)) {
+        return;
+    }
+    while (time < end) {
+        keyset_t left = keys;
+        for (int code = keyset_pop(left); (code >= 0) && (time < end);
+             code = keyset_pop(left)) {
+            action_type_t type = bindings.lookup(code).type;
+            uint64_t hold = ((ACTION_MOVE == type) || (ACTION_SCROLL == type)) ?
+                            SIM_MOVE_HOLD : SIM_BUTTON_HOLD;
+            script_key(time, code, true);
+            script_key(time + hold, code, false);
+            time += hold + SIM_GAP;
+        }
+    }
+}
+
+/**
+ * Put the script in time order
+ */
+void
+SimInput::sort (void)
+{
+    if (!sorted) {
+        std::stable_sort(script.begin() + std::min(delivered, applied),
+                         script.end(), sim_key_before);
+        sorted = true;
+    }
+}
+
+/**
+ * True if an event is due
+ */
+bool
+SimInput::pending (void)
+{
+    sort();
+    return (delivered < script.size()) && (script[delivered].time <= clock);
+}
+
+/**
+ * Get the next event, jumping the clock to it if it is not due yet
+ */
+void
+SimInput::next_event (input_event_t &event)
+{
+    sort();
+    event.type = INPUT_NONE;
+    if (delivered == script.size()) {
+        /* nothing will ever happen again */
+        clock = std::max(clock, end);
+        return;
+    }
+
+    const sim_key_t &key = script[delivered++];
+    clock = std::max(clock, key.time);
+    event.type = INPUT_KEY;
+    event.code = key.code;
+    event.pressed = key.pressed;
+    event.time = key.time;
+}
+
+/**
+ * Nothing to ask for, the state is at hand
+ */
+void
+SimInput::request_keys (void)
+{
+}
+
+/**
+ * Get the keys held at the current virtual time
+ */
+void
+SimInput::query_keys (keyset_t &keys)
+{
+    sort();
+    while ((applied < script.size()) && (script[applied].time <= clock)) {
+        keyset_set(held, script[applied].code, script[applied].pressed);
+        applied++;
+    }
+    keys = held;
+}
+
+/**
+ * Virtual clock in nanoseconds
+ */
+uint64_t
+SimInput::now (void)
+{
+    return clock;
+}
+
+/**
+ * Advance the virtual clock to the deadline, a tick takes no time at all
+ */
+void
+SimInput::sleep_until (uint64_t deadline)
+{
+    clock = std::max(clock, deadline);
+}
+
+/**
+ * True once the virtual clock has reached the end
+ */
+bool
+SimInput::done (void)
+{
+    return clock >= end;
+}
+
+/**
+ * Constructor with the initial pointer position
+ */
+SimOutput::SimOutput (int x, int y)
+    : x(x), y(y), grabs(0), motions(0), buttons(0), notches(0),
+      grids(0), flushes(0), queries(0)
+{
+}
+
+/**
+ * SimOutput destructor
+ */
+SimOutput::~SimOutput (void)
+{
+}
+
+/**
+ * Grab the given keys
+ */
+void
+SimOutput::grab_keys (const KeyCode *keys, int count, unsigned int modifiers)
+{
+    grabs++;
+}
+
+/**
+ * Release the given keys
+ */
+void
+SimOutput::ungrab_keys (const KeyCode *keys, int count, unsigned int modifiers)
+{
+}
+
+/**
+ * Get the pointer position
+ */
+void
+SimOutput::query_pointer (int &x, int &y)
+{
+    queries++;
+    x = this->x;
+    y = this->y;
+}
+
+/**
+ * Move the pointer to the given coordinates
+ */
+void
+SimOutput::warp_pointer (int x, int y)
+{
+    motions++;
+    this->x = x;
+    this->y = y;
+}
+
+/**
+ * Move the pointer relative to its current position
+ */
+void
+SimOutput::move_pointer (int dx, int dy)
+{
+    motions++;
+    x += dx;
+    y += dy;
+}
+
+/**
+ * Press or release a mouse button
+ */
+void
+SimOutput::fake_button (unsigned int button, bool press)
+{
+    buttons++;
+}
+
+/**
+ * Turn the wheels by whole notches
+ */
+void
+SimOutput::scroll (int dx, int dy)
+{
+    notches += std::abs(dx) + std::abs(dy);
+}
+
+/**
+ * Show the navigation grid, or move it
+ */
+void
+SimOutput::show_grid (int x, int y, int width, int height)
+{
+    grids++;
+}
+
+/**
+ * Hide the navigation grid
+ */
+void
+SimOutput::hide_grid (void)
+{
+    grids++;
+}
+
+/**
+ * Send out whatever is queued
+ */
+void
+SimOutput::flush (void)
+{
+    flushes++;
+}
+
+/**
+ * Number of pointer queries, the only requests that would need a reply
+ */
+unsigned long
+SimOutput::round_trips (void) const
+{
+    return queries;
+}
@@ -0,0 +1,139 @@
+/*
+ *------------------------------------------------------------------------------
+ *
+ * sim.h
+ *
+ * Headless simulation backend of project keymouse
+ *
+ * Copyright (c) 2017 Zoltan Toth <ztoth AT thetothfamily DOT net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *------------------------------------------------------------------------------
+ */
+#ifndef SIM_H_
+#define SIM_H_
+
+#include <vector>
+#include <stdint.h>
+
+#include "io.h"
+#include "bindings.h"
+
+/** one scripted key transition */
+typedef struct sim_key_s {
+    uint64_t time;                                /** virtual nsec */
+    unsigned int code;
+    bool pressed;
+} sim_key_t;
+
+/**
+ * SimInput class
+ *
+ * In-memory input source with a virtual clock. The key transitions are
+ * scripted in advance; they show up both as events and in the keyboard state
+ * once the clock reaches them. Sleeping only advances the clock, and waiting
+ * for an event jumps it straight to the next scripted transition, so hours of
+ * virtual time go by in milliseconds.
+ */
+class SimInput : public InputSource {
+  public:
+    /** constructor, the input ends at the given virtual time (nsec) */
+    SimInput (uint64_t end);
+
+    /** default destructor */
+    virtual ~SimInput (void);
+
+    /** add a key transition, in any order */
+    void script_key (uint64_t time, unsigned int code, bool pressed);
+
+    /** script a session: grab, then play with every bound key until the end */
+    void script_session (unsigned int trigger, const Bindings &bindings);
+
+    /** true if an event is due */
+    virtual bool pending (void);
+
+    /** get the next event, jumping the clock to it if it is not due yet */
+    virtual void next_event (input_event_t &event);
+
+    /** nothing to ask for, the state is at hand */
+    virtual void request_keys (void);
+
+    /** get the keys held at the current virtual time */
+    virtual void query_keys (keyset_t &keys);
+
+    /** virtual clock in nanoseconds */
+    virtual uint64_t now (void);
+
+    /** advance the virtual clock to the deadline */
+    virtual void sleep_until (uint64_t deadline);
+
+    /** true once the virtual clock has reached the end */
+    virtual bool done (void);
+
+  private:
+    uint64_t clock;                               /** virtual time */
+    uint64_t end;                                 /** end of the input */
+    std::vector<sim_key_t> script;                /** transitions */
+    bool sorted;                                  /** script is in order */
+    size_t delivered;                             /** next event to deliver */
+    size_t applied;                               /** next state change */
+    keyset_t held;                                /** keyboard state */
+
+    /** put the script in time order before it is first used */
+    void sort (void);
+};
+
+/**
+ * SimOutput class
+ *
+ * In-memory output sink, it keeps the pointer position and counts what it is
+ * asked to do.
+ */
+class SimOutput : public OutputSink {
+  public:
+    /** constructor, the pointer starts at the given position */
+    SimOutput (int x, int y);
+
+    /** default destructor */
+    virtual ~SimOutput (void);
+
+    virtual void grab_keys (const KeyCode *keys, int count,
+                            unsigned int modifiers);
+    virtual void ungrab_keys (const KeyCode *keys, int count,
+                              unsigned int modifiers);
+    virtual void query_pointer (int &x, int &y);
+    virtual void warp_pointer (int x, int y);
+    virtual void move_pointer (int dx, int dy);
+    virtual void fake_button (unsigned int button, bool press);
+    virtual void scroll (int dx, int dy);
+    virtual void show_grid (int x, int y, int width, int height);
+    virtual void hide_grid (void);
+    virtual void flush (void);
+    virtual unsigned long round_trips (void) const;
+
+    int x;                                        /** pointer position */
+    int y;
+    unsigned long grabs;                          /** grab_keys() calls */
+    unsigned long motions;                        /** warps and moves */
+    unsigned long buttons;                        /** button events */
+    unsigned long notches;                        /** wheel notches */
+    unsigned long grids;                          /** grid updates */
+    unsigned long flushes;                        /** flush() calls */
+
+  private:
+    unsigned long queries;                        /** query_pointer() calls */
+};
+
+#endif /* SIM_H_ */
@@ -0,0 +1,236 @@
+/*
+ *------------------------------------------------------------------------------
+ *
+ * stats.cc
+ *
+ * Run-time statistics of project keymouse
+ *
+ * Copyright (c) 2017 Zoltan Toth <ztoth AT thetothfamily DOT net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *------------------------------------------------------------------------------
+ */
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+#include "framework.h"
+#include "stats.h"
+
+/**
+ * Constructor
+ */
+Histogram::Histogram (void)
+{
+    reset();
+}
+
+/**
+ * Bucket index of a value
+ */
+int
+Histogram::bucket (uint64_t value)
+{
+    if (value < (1ULL << HISTOGRAM_SUB_BITS)) {
+        return (int)value;
+    }
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - HISTOGRAM_SUB_BITS;
+    int sub = (value >> shift) & ((1 << HISTOGRAM_SUB_BITS) - 1);
+    return ((shift + 1) << HISTOGRAM_SUB_BITS) + sub;
+}
+
+/**
+ * Largest value that falls into the given bucket
+ */
+uint64_t
+Histogram::bucket_limit (int index)
+{
+    if (index < (1 << HISTOGRAM_SUB_BITS)) {
+        return index;
+    }
+    int shift = (index >> HISTOGRAM_SUB_BITS) - 1;
+    uint64_t sub = index & ((1 << HISTOGRAM_SUB_BITS) - 1);
+    uint64_t lower = ((1ULL << HISTOGRAM_SUB_BITS) + sub) << shift;
+    return lower + ((1ULL << shift) - 1);
+}
+
+/**
+ * Add a value
+ */
+void
+Histogram::record (uint64_t value)
+{
+    buckets[bucket(value)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(value, std::memory_order_relaxed);
+
+    uint64_t current = largest.load(std::memory_order_relaxed);
+    while ((value > current) &&
+           !largest.compare_exchange_weak(current, value,
+                                          std::memory_order_relaxed)) {
+    }
+}
+
+/**
+ * Forget every value
+ */
+void
+Histogram::reset (void)
+{
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        buckets[i].store(0, std::memory_order_relaxed);
+    }
+    total.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+    largest.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * Number of values
+ */
+uint64_t
+Histogram::count (void) const
+{
+    return total.load(std::memory_order_relaxed);
+}
+
+/**
+ * The largest value
+ */
+uint64_t
+Histogram::max (void) const
+{
+    return largest.load(std::memory_order_relaxed);
+}
+
+/**
+ * Average of the values
+ */
+double
+Histogram::mean (void) const
+{
+    uint64_t n = count();
+    return n ? (double)sum.load(std::memory_order_relaxed) / n : 0.0;
+}
+
+/**
+ * Upper bound of the bucket holding the given percentile
+ *
+ * The bound is capped at the largest value, so a narrow distribution is not
+ * reported wider than it is.
+ */
+uint64_t
+Histogram::percentile (double p) const
+{
+    uint64_t n = count();
+    if (0 == n) {
+        return 0;
+    }
+
+    /* rank of the value we are looking for, counted from 1 */
+    uint64_t rank = (uint64_t)(p / 100.0 * n + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            return std::min(bucket_limit(i), max());
+        }
+    }
+    return max();
+}
+
+/**
+ * One line summary of the histogram
+ */
+std::string
+Histogram::summary (void) const
+{
+    std::stringstream strstr;
+    strstr << "n=" << count() << " mean=" << std::fixed << std::setprecision(1)
+           << mean() << " p50=" << percentile(50.0) << " p90="
+           << percentile(90.0) << " p99=" << percentile(99.0) << " p99.9="
+           << percentile(99.9) << " max=" << max();
+    return strstr.str();
+}
+
+/**
+ * The counters on one line
+ */
+std::string
+stats_counters (stats_t &stats)
+{
+    std::stringstream strstr;
+    strstr << "ticks=" << stats.ticks.load() << " overruns="
+           << stats.overruns.load() << " key_events="
+           << stats.key_events.load() << " warps=" << stats.warps.load()
+           << " buttons=" << stats.buttons.load() << " notches="
+           << stats.notches.load() << " commands="
+           << stats.commands.load();
+    return strstr.str();
+}
+
+/**
+ * Write every histogram and counter to the log
+ *
+ * This also works in release builds, where dbug() is compiled out, so the
+ * numbers go straight to wherever the log messages would go. They are written
+ * under the lock of the logger thread, never at the same time as a message.
+ */
+void
+stats_dump (stats_t &stats)
+{
+    std::stringstream lines[6];
+    lines[0] << "tick jitter (usec): " << stats.tick_jitter.summary();
+    lines[1] << "key to motion latency (usec): " << stats.key_latency.summary();
+    lines[2] << "key to button latency (usec): "
+             << stats.click_latency.summary();
+    lines[3] << "round trips per tick: " << stats.round_trips.summary();
+    lines[4] << "flush time (usec): " << stats.flush_time.summary();
+    lines[5] << "counters: " << stats_counters(stats);
+
+    for (int i = 0; i < 6; i++) {
+        if (framework::log_to_syslog) {
+            framework::log_print("stats: " + lines[i].str());
+        } else {
+            framework::log_print(framework::project_name + " stats: " +
+                                 lines[i].str());
+        }
+    }
+}
+
+/**
+ * Forget every value
+ */
+void
+stats_reset (stats_t &stats)
+{
+    stats.tick_jitter.reset();
+    stats.key_latency.reset();
+    stats.click_latency.reset();
+    stats.round_trips.reset();
+    stats.flush_time.reset();
+    stats.ticks.store(0);
+    stats.overruns.store(0);
+    stats.key_events.store(0);
+    stats.warps.store(0);
+    stats.buttons.store(0);
+    stats.notches.store(0);
+    stats.commands.store(0);
+}
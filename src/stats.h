@@ -0,0 +1,111 @@
+/*
+ *------------------------------------------------------------------------------
+ *
+ * stats.h
+ *
+ * Run-time statistics of project keymouse
+ *
+ * Copyright (c) 2017 Zoltan Toth <ztoth AT thetothfamily DOT net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *------------------------------------------------------------------------------
+ */
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <atomic>
+#include <string>
+#include <stdint.h>
+
+/** sub-buckets per power of two, the relative error of a bucket is 1/8 */
+#define HISTOGRAM_SUB_BITS 3
+
+/** number of buckets, enough for any 64-bit value */
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS)
+
+/**
+ * Histogram class
+ *
+ * Fixed-bucket, log-linear histogram: values below 8 have a bucket of their
+ * own, above that every power of two is split into 8 equal buckets. Recording
+ * is a couple of relaxed atomic increments, so the main loop can record while
+ * the signal handler thread reads or resets, without any locking. A reading
+ * taken meanwhile may be off by the values recorded at the same time.
+ */
+class Histogram {
+  public:
+    /** constructor */
+    Histogram (void);
+
+    /** add a value */
+    void record (uint64_t value);
+
+    /** forget every value */
+    void reset (void);
+
+    /** number of values */
+    uint64_t count (void) const;
+
+    /** the largest value */
+    uint64_t max (void) const;
+
+    /** average of the values */
+    double mean (void) const;
+
+    /** upper bound of the bucket holding the given percentile (0-100) */
+    uint64_t percentile (double p) const;
+
+    /** one line summary, e.g. "n=10 mean=3.0 p50=3 p99=4 max=4" */
+    std::string summary (void) const;
+
+  private:
+    std::atomic<uint64_t> buckets[HISTOGRAM_BUCKETS];
+    std::atomic<uint64_t> total;                  /** number of values */
+    std::atomic<uint64_t> sum;                    /** sum of the values */
+    std::atomic<uint64_t> largest;                /** largest value */
+
+    /** bucket index of a value */
+    static int bucket (uint64_t value);
+
+    /** largest value that falls into the given bucket */
+    static uint64_t bucket_limit (int index);
+};
+
+/** statistics of the main loop */
+typedef struct stats_s {
+    Histogram tick_jitter;              /** tick period error, usec */
+    Histogram key_latency;              /** key press to pointer motion, usec */
+    Histogram click_latency;            /** button key to button event, usec */
+    Histogram round_trips;              /** X round trips per tick */
+    Histogram flush_time;               /** time spent flushing, usec */
+    std::atomic<uint64_t> ticks;        /** movement ticks */
+    std::atomic<uint64_t> overruns;     /** tick deadlines missed */
+    std::atomic<uint64_t> key_events;   /** key transitions processed */
+    std::atomic<uint64_t> warps;        /** pointer motion requests */
+    std::atomic<uint64_t> buttons;      /** fake button events */
+    std::atomic<uint64_t> notches;      /** wheel notches scrolled */
+    std::atomic<uint64_t> commands;     /** control socket requests */
+} stats_t;
+
+/** the counters on one line, e.g. "ticks=10 overruns=0 ..." */
+std::string stats_counters (stats_t &stats);
+
+/** write every histogram and counter to the log (stdout, file or syslog) */
+void stats_dump (stats_t &stats);
+
+/** forget every value */
+void stats_reset (stats_t &stats);
+
+#endif /* STATS_H_ */
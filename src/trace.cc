@@ -0,0 +1,190 @@
+/*
+ *------------------------------------------------------------------------------
+ *
+ * trace.cc
+ *
+ * Session recording of project keymouse
+ *
+ * Copyright (c) 2017 Zoltan Toth <ztoth AT thetothfamily DOT net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *------------------------------------------------------------------------------
+ */
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "framework.h"
+#include "trace.h"
+
+/* the file format depends on it */
+static_assert(sizeof(trace_record_t) == 32, "trace records must be 32 bytes");
+
+/**
+ * Constructor
+ */
+TraceWriter::TraceWriter (void)
+    : fd(-1), count(0)
+{
+}
+
+/**
+ * TraceWriter destructor
+ */
+TraceWriter::~TraceWriter (void)
+{
+    flush();
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+/**
+ * Open the file for appending
+ */
+bool
+TraceWriter::open (const std::string &path)
+{
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        dbug(DEBUG_LEVEL_ERROR, DEBUG_TYPE_FRAMEWORK,
+             "cannot open " << path << ": " << strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Add a record
+ */
+void
+TraceWriter::write (uint64_t time, trace_type_t type, unsigned int code,
+                    int value, int x, int y, int w, int h)
+{
+    trace_record_t &record = buffer[count++];
+    record.time = time;
+    record.type = type;
+    record.code = code;
+    record.value = value;
+    record.x = x;
+    record.y = y;
+    record.w = w;
+    record.h = h;
+
+    if (TRACE_BUFFER_SIZE == count) {
+        flush();
+    }
+}
+
+/**
+ * Add a record with a floating point value in place of the time
+ */
+void
+TraceWriter::write_double (trace_type_t type, unsigned int code, double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    write(bits, type, code);
+}
+
+/**
+ * Write out the buffered records
+ *
+ * Whole records are appended with a single write, so a trace cut short by a
+ * crash is still readable up to its last record.
+ */
+void
+TraceWriter::flush (void)
+{
+    if ((fd >= 0) && count) {
+        if (::write(fd, buffer, count * sizeof(trace_record_t)) < 0) {
+            dbug(DEBUG_LEVEL_ERROR, DEBUG_TYPE_FRAMEWORK,
+                 "cannot write trace: " << strerror(errno));
+        }
+    }
+    count = 0;
+}
+
+/**
+ * Constructor
+ */
+TraceReader::TraceReader (void)
+    : fd(-1), count(0), next(0)
+{
+}
+
+/**
+ * TraceReader destructor
+ */
+TraceReader::~TraceReader (void)
+{
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+/**
+ * Open the file for reading
+ */
+bool
+TraceReader::open (const std::string &path)
+{
+    fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        dbug(DEBUG_LEVEL_ERROR, DEBUG_TYPE_FRAMEWORK,
+             "cannot open " << path << ": " << strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Get the next record, a truncated one at the end of the file is ignored
+ */
+bool
+TraceReader::read (trace_record_t &record)
+{
+    if (next == count) {
+        ssize_t length;
+        do {
+            length = ::read(fd, buffer, sizeof(buffer));
+        } while ((length < 0) && (EINTR == errno));
+        if (length < (ssize_t)sizeof(trace_record_t)) {
+            return false;
+        }
+        count = length / sizeof(trace_record_t);
+        next = 0;
+
+        /* a read may stop in the middle of a record, go back to its start */
+        off_t rest = length % sizeof(trace_record_t);
+        if (rest) {
+            lseek(fd, -rest, SEEK_CUR);
+        }
+    }
+    record = buffer[next++];
+    return true;
+}
+
+/**
+ * The floating point value of a record written with write_double()
+ */
+double
+TraceReader::value_double (const trace_record_t &record)
+{
+    double value;
+    memcpy(&value, &record.time, sizeof(value));
+    return value;
+}
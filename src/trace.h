@@ -0,0 +1,165 @@
+/*
+ *------------------------------------------------------------------------------
+ *
+ * trace.h
+ *
+ * Session recording of project keymouse
+ *
+ * Copyright (c) 2017 Zoltan Toth <ztoth AT thetothfamily DOT net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *------------------------------------------------------------------------------
+ */
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdint.h>
+#include <string>
+
+/** "KMTRACE1", the time of the header record */
+#define TRACE_MAGIC 0x3145434152544d4bULL
+
+/** format version, the code of the header record */
+#define TRACE_VERSION 3
+
+/** oldest version a replay still reads */
+#define TRACE_VERSION_OLDEST 2
+
+/** number of records buffered before they are written out */
+#define TRACE_BUFFER_SIZE 128
+
+/** record types */
+typedef enum trace_type_e {
+    TRACE_HEADER = 1,           /** value: loop type, starts a session */
+    TRACE_CONFIG,               /** code: trigger, value: flags, x: edges,
+                                    y: number of TRACE_BIND records after the
+                                    TRACE_PARAM ones */
+    TRACE_PARAM,                /** code: parameter, time: value (double) */
+    TRACE_BIND,                 /** code: key, value: action, x: argument */
+    TRACE_LAYOUT,               /** code: index, value: count, x/y/w/h */
+    TRACE_GRAB,                 /** value: grabbed, x/y: pointer position */
+    TRACE_KEY,                  /** code: key, value: pressed */
+    TRACE_TICK,                 /** movement tick */
+    TRACE_WARP,                 /** emitted: x/y: absolute position */
+    TRACE_MOVE,                 /** emitted: x/y: relative motion */
+    TRACE_BUTTON,               /** emitted: code: button, value: pressed */
+    TRACE_SCROLL,               /** emitted: x/y: wheel notches */
+    TRACE_CLICK                 /** code: key, value: pressed, a button key
+                                    applied at once by the polling loop */
+} trace_type_t;
+
+/** loop types in the header */
+typedef enum trace_loop_e {
+    TRACE_LOOP_POLLING,
+    TRACE_LOOP_REACTOR,
+    TRACE_LOOP_RAW                              /** reactor with XInput2 */
+} trace_loop_t;
+
+/** config flags */
+typedef enum trace_flag_e {
+    TRACE_FLAG_RELATIVE = 0x1,
+    TRACE_FLAG_NUMLOCK = 0x2
+} trace_flag_t;
+
+/** motion and scroll parameters */
+typedef enum trace_param_e {
+    TRACE_PARAM_SPEED,
+    TRACE_PARAM_MAX_SPEED,
+    TRACE_PARAM_SLOW_SPEED,
+    TRACE_PARAM_ACCEL_TIME,
+    TRACE_PARAM_CURVE,
+    TRACE_PARAM_SCROLL_SPEED,
+    TRACE_PARAM_SCROLL_MAX_SPEED,
+    TRACE_PARAM_SCROLL_SLOW_SPEED,
+    TRACE_PARAM_SCROLL_CURVE,
+    TRACE_PARAM_COUNT
+} trace_param_t;
+
+/** one record, every record has the same size */
+typedef struct trace_record_s {
+    uint64_t time;                                /** monotonic nsec */
+    uint16_t type;                                /** trace_type_t */
+    uint16_t code;
+    int32_t value;
+    int32_t x;
+    int32_t y;
+    int32_t w;
+    int32_t h;
+} trace_record_t;
+
+/**
+ * TraceWriter class
+ *
+ * Appends fixed-size records to a trace file. The records are collected in a
+ * small buffer and written out with a single write() when it is full, or when
+ * flush() is called, so recording does not add a system call to every tick.
+ */
+class TraceWriter {
+  public:
+    /** constructor */
+    TraceWriter (void);
+
+    /** destructor, flushes the buffer and closes the file */
+    virtual ~TraceWriter (void);
+
+    /** open the file for appending, false on error */
+    bool open (const std::string &path);
+
+    /** add a record */
+    void write (uint64_t time, trace_type_t type, unsigned int code = 0,
+                int value = 0, int x = 0, int y = 0, int w = 0, int h = 0);
+
+    /** add a record with a floating point value in place of the time */
+    void write_double (trace_type_t type, unsigned int code, double value);
+
+    /** write out the buffered records */
+    void flush (void);
+
+  private:
+    int fd;                                       /** trace file */
+    int count;                                    /** buffered records */
+    trace_record_t buffer[TRACE_BUFFER_SIZE];     /** record buffer */
+};
+
+/**
+ * TraceReader class
+ *
+ * Reads the records of a trace file one by one.
+ */
+class TraceReader {
+  public:
+    /** constructor */
+    TraceReader (void);
+
+    /** destructor, closes the file */
+    virtual ~TraceReader (void);
+
+    /** open the file for reading, false on error */
+    bool open (const std::string &path);
+
+    /** get the next record, false at the end of the file */
+    bool read (trace_record_t &record);
+
+    /** the floating point value of a record written with write_double() */
+    static double value_double (const trace_record_t &record);
+
+  private:
+    int fd;                                       /** trace file */
+    int count;                                    /** buffered records */
+    int next;                                     /** next buffered record */
+    trace_record_t buffer[TRACE_BUFFER_SIZE];     /** record buffer */
+};
+
+#endif /* TRACE_H_ */
@@ -0,0 +1,471 @@
+/*
+ *------------------------------------------------------------------------------
+ *
+ * windows.cc
+ *
+ * Window geometry index of project keymouse
+ *
+ * Copyright (c) 2017 Zoltan Toth <ztoth AT thetothfamily DOT net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *------------------------------------------------------------------------------
+ */
+#include <climits>
+#include <cstdlib>
+#include <algorithm>
+
+#include "framework.h"
+#include "windows.h"
+
+/** axes of the sorted lists */
+#define AXIS_X 0
+#define AXIS_Y 1
+
+/**
+ * Ignore the errors of a request about a window that may be gone already
+ */
+static int
+ignore_error (Display *display, XErrorEvent *error)
+{
+    return 0;
+}
+
+/**
+ * Put an entry into a sorted list, or take it out
+ */
+static void
+update_list (std::vector<window_entry_t> &list, const window_entry_t &entry,
+             bool insert)
+{
+    std::vector<window_entry_t>::iterator it =
+        std::lower_bound(list.begin(), list.end(), entry);
+    if (insert) {
+        list.insert(it, entry);
+    } else if ((it != list.end()) && (it->at == entry.at) &&
+               (it->window == entry.window)) {
+        list.erase(it);
+    }
+}
+
+/**
+ * Move a coordinate to the nearest edge in a direction, of those that span the
+ * other coordinate
+ *
+ * The list is in coordinate order, so the first edge spanning the point is the
+ * nearest one.
+ */
+static bool
+next_edge (const std::vector<window_entry_t> &list, int &at, int across,
+           int dir)
+{
+    window_entry_t key;
+    key.at = at;
+    key.window = (dir > 0) ? ~(Window)0 : 0;
+    size_t first = std::lower_bound(list.begin(), list.end(), key) -
+                   list.begin();
+
+    if (dir > 0) {
+        for (size_t i = first; i < list.size(); i++) {
+            if ((list[i].at > at) && (list[i].from <= across) &&
+                (across <= list[i].to)) {
+                at = list[i].at;
+                return true;
+            }
+        }
+    } else {
+        for (size_t i = first; i-- > 0; ) {
+            if ((list[i].from <= across) && (across <= list[i].to)) {
+                at = list[i].at;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * Constructor with the display and its root window
+ */
+Windows::Windows (Display *display, Window root)
+    : display(display), root(root)
+{
+}
+
+/**
+ * Windows destructor
+ */
+Windows::~Windows (void)
+{
+    clients.clear();
+}
+
+/**
+ * Build the index with a single walk of the window tree
+ *
+ * The notifications must be selected already, so no window can slip through
+ * between the walk and the first event.
+ */
+void
+Windows::init (void)
+{
+    Window root_return, parent;
+    Window *children = NULL;
+    unsigned int n = 0;
+    if (!XQueryTree(display, root, &root_return, &parent, &children, &n)) {
+        dbug(DEBUG_LEVEL_WARNING, DEBUG_TYPE_FRAMEWORK,
+             "cannot query the window tree");
+        return;
+    }
+
+    for (unsigned int i = 0; i < n; i++) {
+        client_t client;
+        if (query(children[i], client)) {
+            add(children[i], client.rect, client.mapped,
+                client.override_redirect);
+        }
+    }
+    if (children) {
+        XFree(children);
+    }
+    dbug(DEBUG_LEVEL_VERBOSE, DEBUG_TYPE_FRAMEWORK,
+         "indexed " << count() << " of " << clients.size() << " windows");
+}
+
+/**
+ * Update the index if this is a notification about a child of the root
+ */
+bool
+Windows::handle_event (XEvent &event)
+{
+    switch (event.type) {
+    case CreateNotify: {
+        XCreateWindowEvent &e = event.xcreatewindow;
+        if (e.parent != root) {
+            return false;
+        }
+        monitor_t rect;
+        rect.x = e.x;
+        rect.y = e.y;
+        rect.width = e.width + 2 * e.border_width;
+        rect.height = e.height + 2 * e.border_width;
+        add(e.window, rect, false, e.override_redirect);
+        break;
+    }
+    case DestroyNotify:
+        if (event.xdestroywindow.event != root) {
+            return false;
+        }
+        remove(event.xdestroywindow.window);
+        break;
+    case MapNotify:
+        if (event.xmap.event != root) {
+            return false;
+        }
+        set_mapped(event.xmap.window, true, event.xmap.override_redirect);
+        break;
+    case UnmapNotify:
+        if (event.xunmap.event != root) {
+            return false;
+        }
+        set_mapped(event.xunmap.window, false, false);
+        break;
+    case ConfigureNotify: {
+        XConfigureEvent &e = event.xconfigure;
+        if ((e.event != root) || (e.window == root)) {
+            return false;
+        }
+        monitor_t rect;
+        rect.x = e.x;
+        rect.y = e.y;
+        rect.width = e.width + 2 * e.border_width;
+        rect.height = e.height + 2 * e.border_width;
+        configure(e.window, rect);
+        break;
+    }
+    case GravityNotify: {
+        if (event.xgravity.event != root) {
+            return false;
+        }
+        std::map<Window, client_t>::iterator it =
+            clients.find(event.xgravity.window);
+        if (it != clients.end()) {
+            monitor_t rect = it->second.rect;
+            rect.x = event.xgravity.x;
+            rect.y = event.xgravity.y;
+            configure(event.xgravity.window, rect);
+        }
+        break;
+    }
+    case ReparentNotify: {
+        XReparentEvent &e = event.xreparent;
+        if (e.event != root) {
+            return false;
+        }
+        if (e.parent != root) {
+            /* the window manager framed it, the frame is what we track */
+            remove(e.window);
+            break;
+        }
+        client_t client;
+        if (query(e.window, client)) {
+            add(e.window, client.rect, client.mapped, client.override_redirect);
+        }
+        break;
+    }
+    default:
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Move the point to the nearest window center in a direction
+ *
+ * The centers are walked outwards from the point along the axis of the
+ * direction, and the walk stops as soon as the distance along the axis alone
+ * is worse than the best candidate. Straying across the axis costs double, so
+ * a window in line wins over a closer one off to the side. A diagonal only
+ * takes centers that are in both directions.
+ */
+bool
+Windows::snap_center (int &x, int &y, int dir_x, int dir_y) const
+{
+    int axis = dir_x ? AXIS_X : AXIS_Y;
+    int dir = dir_x ? dir_x : dir_y;
+    int across_dir = dir_x ? dir_y : 0;
+    int at = (AXIS_X == axis) ? x : y;
+    int across = (AXIS_X == axis) ? y : x;
+    if (!dir) {
+        return false;
+    }
+
+    const std::vector<window_entry_t> &list = centers[axis];
+    window_entry_t key;
+    key.at = at;
+    key.window = (dir > 0) ? ~(Window)0 : 0;
+    size_t first = std::lower_bound(list.begin(), list.end(), key) -
+                   list.begin();
+
+    long best = LONG_MAX;
+    const window_entry_t *found = NULL;
+    for (size_t n = 0; ; n++) {
+        const window_entry_t *entry;
+        if (dir > 0) {
+            if (first + n >= list.size()) {
+                break;
+            }
+            entry = &list[first + n];
+        } else {
+            if (n >= first) {
+                break;
+            }
+            entry = &list[first - n - 1];
+        }
+
+        long distance = std::labs((long)entry->at - at);
+        if (distance >= best) {
+            break;
+        }
+        long stray = (long)entry->from - across;
+        if ((0 == distance) || (across_dir && (stray * across_dir <= 0))) {
+            continue;
+        }
+        long score = distance + (across_dir ? std::labs(stray) :
+                                              2 * std::labs(stray));
+        if (score < best) {
+            best = score;
+            found = entry;
+        }
+    }
+
+    if (!found) {
+        return false;
+    }
+    x = (AXIS_X == axis) ? found->at : found->from;
+    y = (AXIS_X == axis) ? found->from : found->at;
+    return true;
+}
+
+/**
+ * Move the point to the nearest edge in a direction, of a window under it
+ *
+ * Only the windows that span the point across the axis count, so the pointer
+ * stays in line. A diagonal moves along both axes.
+ */
+bool
+Windows::snap_edge (int &x, int &y, int dir_x, int dir_y) const
+{
+    bool moved = false;
+    if (dir_x) {
+        moved |= next_edge(edges[AXIS_X], x, y, dir_x);
+    }
+    if (dir_y) {
+        moved |= next_edge(edges[AXIS_Y], y, x, dir_y);
+    }
+    return moved;
+}
+
+/**
+ * Number of mapped windows in the index
+ */
+int
+Windows::count (void) const
+{
+    return centers[AXIS_X].size();
+}
+
+/**
+ * Replace the index with these mapped windows
+ *
+ * They get made-up window ids. Notifications from the server update the index
+ * as usual.
+ */
+void
+Windows::set_windows (const std::vector<monitor_t> &rects)
+{
+    clients.clear();
+    for (int axis = AXIS_X; axis <= AXIS_Y; axis++) {
+        centers[axis].clear();
+        edges[axis].clear();
+    }
+    for (size_t i = 0; i < rects.size(); i++) {
+        add(i + 1, rects[i], true, false);
+    }
+}
+
+/**
+ * Track a new child of the root, replacing what we knew about it
+ */
+void
+Windows::add (Window window, const monitor_t &rect, bool mapped,
+              bool override_redirect)
+{
+    remove(window);
+    client_t &client = clients[window];
+    client.rect = rect;
+    client.mapped = mapped;
+    client.override_redirect = override_redirect;
+    index(window, client, true);
+}
+
+/**
+ * Stop tracking a child of the root
+ */
+void
+Windows::remove (Window window)
+{
+    std::map<Window, client_t>::iterator it = clients.find(window);
+    if (it != clients.end()) {
+        index(window, it->second, false);
+        clients.erase(it);
+    }
+}
+
+/**
+ * Move or resize a child of the root
+ */
+void
+Windows::configure (Window window, const monitor_t &rect)
+{
+    std::map<Window, client_t>::iterator it = clients.find(window);
+    if (it != clients.end()) {
+        index(window, it->second, false);
+        it->second.rect = rect;
+        index(window, it->second, true);
+    }
+}
+
+/**
+ * Map or unmap a child of the root
+ */
+void
+Windows::set_mapped (Window window, bool mapped, bool override_redirect)
+{
+    std::map<Window, client_t>::iterator it = clients.find(window);
+    if (it != clients.end()) {
+        index(window, it->second, false);
+        it->second.mapped = mapped;
+        if (mapped) {
+            it->second.override_redirect = override_redirect;
+        }
+        index(window, it->second, true);
+    }
+}
+
+/**
+ * Add a client to the sorted lists, or take it out
+ *
+ * Only the mapped, managed windows are in the lists. Each one has a center and
+ * two edges on both axes; the far edges are the last pixels inside it.
+ */
+void
+Windows::index (Window window, const client_t &client, bool insert)
+{
+    const monitor_t &r = client.rect;
+    if (!client.mapped || client.override_redirect || (r.width <= 0) ||
+        (r.height <= 0)) {
+        return;
+    }
+
+    window_entry_t entry;
+    entry.window = window;
+
+    entry.at = r.x + r.width / 2;
+    entry.from = entry.to = r.y + r.height / 2;
+    update_list(centers[AXIS_X], entry, insert);
+    entry.at = r.y + r.height / 2;
+    entry.from = entry.to = r.x + r.width / 2;
+    update_list(centers[AXIS_Y], entry, insert);
+
+    entry.from = r.y;
+    entry.to = r.y + r.height - 1;
+    entry.at = r.x;
+    update_list(edges[AXIS_X], entry, insert);
+    entry.at = r.x + r.width - 1;
+    update_list(edges[AXIS_X], entry, insert);
+
+    entry.from = r.x;
+    entry.to = r.x + r.width - 1;
+    entry.at = r.y;
+    update_list(edges[AXIS_Y], entry, insert);
+    entry.at = r.y + r.height - 1;
+    update_list(edges[AXIS_Y], entry, insert);
+}
+
+/**
+ * Ask the server for the geometry of a window
+ *
+ * The window may be destroyed by the time the request arrives, so the error
+ * is ignored instead of taking keymouse down.
+ */
+bool
+Windows::query (Window window, client_t &client)
+{
+    XWindowAttributes attrs;
+    int (*handler)(Display*, XErrorEvent*) = XSetErrorHandler(ignore_error);
+    Status status = XGetWindowAttributes(display, window, &attrs);
+    XSetErrorHandler(handler);
+    if (!status || (InputOnly == attrs.c_class)) {
+        return false;
+    }
+
+    client.rect.x = attrs.x;
+    client.rect.y = attrs.y;
+    client.rect.width = attrs.width + 2 * attrs.border_width;
+    client.rect.height = attrs.height + 2 * attrs.border_width;
+    client.mapped = (IsViewable == attrs.map_state);
+    client.override_redirect = attrs.override_redirect;
+    return true;
+}
@@ -0,0 +1,120 @@
+/*
+ *------------------------------------------------------------------------------
+ *
+ * windows.h
+ *
+ * Window geometry index of project keymouse
+ *
+ * Copyright (c) 2017 Zoltan Toth <ztoth AT thetothfamily DOT net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *------------------------------------------------------------------------------
+ */
+#ifndef WINDOWS_H_
+#define WINDOWS_H_
+
+#include <map>
+#include <vector>
+#include <X11/Xlib.h>
+
+#include "monitors.h"
+
+/** a window center or edge, with the span it covers across its axis */
+typedef struct window_entry_s {
+    int at;                                       /** coordinate on the axis */
+    int from;                                     /** first across the axis */
+    int to;                                       /** last across the axis */
+    Window window;                                /** window it belongs to */
+
+    /** order by coordinate, then window */
+    bool operator< (const struct window_entry_s &other) const
+    {
+        return (at < other.at) ||
+               ((at == other.at) && (window < other.window));
+    }
+} window_entry_t;
+
+/**
+ * Windows class
+ *
+ * Client-side index of the top-level window rectangles, for jumping the
+ * pointer to the next window in a direction. The tree is walked once with
+ * XQueryTree(), after that the index is kept current from the substructure
+ * notifications of the root window, one window at a time. The centers and the
+ * edges of the mapped windows are kept in coordinate order, one list per axis,
+ * so a jump is a binary search and a short walk, without any requests.
+ * Override-redirect windows (menus, tooltips, our own grid) are left out.
+ */
+class Windows {
+  public:
+    /** constructor, pass the opened display and its root window */
+    Windows (Display *display, Window root);
+
+    /** default destructor */
+    virtual ~Windows (void);
+
+    /** build the index, SubstructureNotifyMask must be selected on the root */
+    void init (void);
+
+    /** update the index if this is a notification about it, false otherwise */
+    bool handle_event (XEvent &event);
+
+    /** move the point to the nearest window center in a direction */
+    bool snap_center (int &x, int &y, int dir_x, int dir_y) const;
+
+    /** move the point to the nearest window edge under it in a direction */
+    bool snap_edge (int &x, int &y, int dir_x, int dir_y) const;
+
+    /** number of mapped windows in the index */
+    int count (void) const;
+
+    /** replace the index with these mapped windows, e.g. simulated ones */
+    void set_windows (const std::vector<monitor_t> &rects);
+
+  private:
+    /** a child of the root window */
+    typedef struct client_s {
+        monitor_t rect;                           /** outer geometry */
+        bool mapped;                              /** viewable */
+        bool override_redirect;                   /** not managed */
+    } client_t;
+
+    Display *display;                             /** X display connection */
+    Window root;                                  /** root window */
+    std::map<Window, client_t> clients;           /** children of the root */
+    std::vector<window_entry_t> centers[2];       /** centers, per axis */
+    std::vector<window_entry_t> edges[2];         /** edges, per axis */
+
+    /** track a new child of the root */
+    void add (Window window, const monitor_t &rect, bool mapped,
+              bool override_redirect);
+
+    /** stop tracking a child of the root */
+    void remove (Window window);
+
+    /** move or resize a child of the root */
+    void configure (Window window, const monitor_t &rect);
+
+    /** map or unmap a child of the root */
+    void set_mapped (Window window, bool mapped, bool override_redirect);
+
+    /** add a client to the sorted lists, or take it out */
+    void index (Window window, const client_t &client, bool insert);
+
+    /** ask the server for the geometry of a window, false if it is gone */
+    bool query (Window window, client_t &client);
+};
+
+#endif /* WINDOWS_H_ */
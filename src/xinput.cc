@@ -0,0 +1,160 @@
+/*
+ *------------------------------------------------------------------------------
+ *
+ * xinput.cc
+ *
+ * XInput2 raw key event source of project keymouse
+ *
+ * Copyright (c) 2017 Zoltan Toth <ztoth AT thetothfamily DOT net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *------------------------------------------------------------------------------
+ */
+#include <X11/extensions/XInput2.h>
+
+#include "framework.h"
+#include "xinput.h"
+
+/**
+ * Constructor with the display and its root window
+ */
+RawKeys::RawKeys (Display *display, Window root)
+    : display(display), root(root), opcode(-1), keyboard(-1)
+{
+}
+
+/**
+ * RawKeys destructor
+ */
+RawKeys::~RawKeys (void)
+{
+}
+
+/**
+ * Check for XInput 2.1 and select raw key events on the root window
+ */
+bool
+RawKeys::init (void)
+{
+    int event, error;
+    if (!XQueryExtension(display, "XInputExtension", &opcode, &event, &error)) {
+        dbug(DEBUG_LEVEL_WARNING, DEBUG_TYPE_FRAMEWORK,
+             "XInput extension is not available");
+        return false;
+    }
+
+    /* raw events are only delivered regardless of grabs since 2.1 */
+    int major = 2;
+    int minor = 1;
+    if ((XIQueryVersion(display, &major, &minor) != Success) ||
+        ((2 == major) && (minor < 1))) {
+        dbug(DEBUG_LEVEL_WARNING, DEBUG_TYPE_FRAMEWORK,
+             "XInput " << major << "." << minor << " is too old");
+        return false;
+    }
+
+    /* find the master keyboard paired with the client pointer */
+    int pointer;
+    if (XIGetClientPointer(display, None, &pointer)) {
+        int count;
+        XIDeviceInfo *info = XIQueryDevice(display, pointer, &count);
+        if (info) {
+            keyboard = info->attachment;
+            XIFreeDeviceInfo(info);
+        }
+    }
+    if (keyboard < 0) {
+        dbug(DEBUG_LEVEL_WARNING, DEBUG_TYPE_FRAMEWORK,
+             "could not find the master keyboard");
+        return false;
+    }
+
+    /* select raw key events of the master devices */
+    unsigned char bits[XIMaskLen(XI_LASTEVENT)] = {0};
+    XIEventMask mask;
+    mask.deviceid = XIAllMasterDevices;
+    mask.mask_len = sizeof(bits);
+    mask.mask = bits;
+    XISetMask(bits, XI_RawKeyPress);
+    XISetMask(bits, XI_RawKeyRelease);
+    XISelectEvents(display, root, &mask, 1);
+
+    dbug(DEBUG_LEVEL_NORMAL, DEBUG_TYPE_FRAMEWORK,
+         "listening on raw key events of keyboard " << keyboard);
+    return true;
+}
+
+/**
+ * Translate an event to a key transition
+ */
+bool
+RawKeys::translate (XEvent &event, KeyCode &code, bool &pressed, Time &time)
+{
+    XGenericEventCookie *cookie = &event.xcookie;
+    if ((GenericEvent != cookie->type) || (cookie->extension != opcode)) {
+        return false;
+    }
+    if ((XI_RawKeyPress != cookie->evtype) &&
+        (XI_RawKeyRelease != cookie->evtype)) {
+        return false;
+    }
+    if (!XGetEventData(display, cookie)) {
+        return false;
+    }
+
+    XIRawEvent *raw = (XIRawEvent*)cookie->data;
+    code = raw->detail;
+    pressed = (XI_RawKeyPress == cookie->evtype);
+    time = raw->time;
+
+    XFreeEventData(display, cookie);
+    return true;
+}
+
+/**
+ * Grab the master keyboard
+ *
+ * No events are selected for the grab, the raw events keep coming anyway. The
+ * grab either succeeds as a whole or fails with AlreadyGrabbed, so there is no
+ * window where only some of the bound keys belong to us.
+ */
+bool
+RawKeys::grab_keyboard (void)
+{
+    unsigned char bits[1] = {0};
+    XIEventMask mask;
+    mask.deviceid = keyboard;
+    mask.mask_len = sizeof(bits);
+    mask.mask = bits;
+
+    Status status = XIGrabDevice(display, keyboard, root, CurrentTime, None,
+                                 XIGrabModeAsync, XIGrabModeAsync, False,
+                                 &mask);
+    if (GrabSuccess != status) {
+        dbug(DEBUG_LEVEL_WARNING, DEBUG_TYPE_FRAMEWORK,
+             "could not grab keyboard " << keyboard << ", status " << status);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Release the master keyboard
+ */
+void
+RawKeys::ungrab_keyboard (void)
+{
+    XIUngrabDevice(display, keyboard, CurrentTime);
+}
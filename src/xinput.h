@@ -0,0 +1,67 @@
+/*
+ *------------------------------------------------------------------------------
+ *
+ * xinput.h
+ *
+ * XInput2 raw key event source of project keymouse
+ *
+ * Copyright (c) 2017 Zoltan Toth <ztoth AT thetothfamily DOT net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *------------------------------------------------------------------------------
+ */
+#ifndef XINPUT_H_
+#define XINPUT_H_
+
+#include <X11/Xlib.h>
+
+/**
+ * RawKeys class
+ *
+ * Key event source built on the XInput2 XI_RawKeyPress/XI_RawKeyRelease
+ * events. Raw events are delivered to the root window regardless of focus and
+ * grabs, so the held keys can be tracked on the client side without asking
+ * the server for the keyboard state. While the mouse is grabbed, the master
+ * keyboard is grabbed as a whole with one request, instead of grabbing each
+ * bound key on the root window one by one.
+ */
+class RawKeys {
+  public:
+    /** constructor, pass the opened display and its root window */
+    RawKeys (Display *display, Window root);
+
+    /** default destructor */
+    virtual ~RawKeys (void);
+
+    /** check for XInput 2.1 and select raw key events, false if unavailable */
+    bool init (void);
+
+    /** translate an event, false if it is not a raw key event */
+    bool translate (XEvent &event, KeyCode &code, bool &pressed, Time &time);
+
+    /** grab the master keyboard, false if someone else has it */
+    bool grab_keyboard (void);
+
+    /** release the master keyboard */
+    void ungrab_keyboard (void);
+
+  private:
+    Display *display;                             /** X display connection */
+    Window root;                                  /** root window */
+    int opcode;                                   /** XInput extension opcode */
+    int keyboard;                                 /** master keyboard device */
+};
+
+#endif /* XINPUT_H_ */
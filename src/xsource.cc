@@ -0,0 +1,171 @@
+/*
+ *------------------------------------------------------------------------------
+ *
+ * xsource.cc
+ *
+ * X server input source of project keymouse
+ *
+ * Copyright (c) 2017 Zoltan Toth <ztoth AT thetothfamily DOT net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *------------------------------------------------------------------------------
+ */
+#include <cerrno>
+#include <time.h>
+#include <poll.h>
+
+#include "framework.h"
+#include "xsource.h"
+
+/**
+ * Get the monotonic time of an X server timestamp
+ *
+ * The server counts milliseconds of the same monotonic clock on Linux. If the
+ * timestamp is way off (the server runs on another host, say), the current
+ * time is the best we can do.
+ */
+uint64_t
+server_time_ns (Time time)
+{
+    uint64_t now = framework::monotonic_ns();
+    uint32_t age = (uint32_t)(now / 1000000) - (uint32_t)time;
+    if (age > 10000) {
+        return now;
+    }
+    return now - (uint64_t)age * 1000000;
+}
+
+/**
+ * Constructor with the display, its backend, monitor cache, window index,
+ * keymap copy and wake-up descriptor
+ */
+XSource::XSource (Display *display, Backend *backend, Monitors *monitors,
+                  Windows *windows, Keymap *keymap, int wake_fd)
+    : display(display), backend(backend), monitors(monitors), windows(windows),
+      keymap(keymap), wake_fd(wake_fd)
+{
+}
+
+/**
+ * XSource destructor
+ */
+XSource::~XSource (void)
+{
+}
+
+/**
+ * True if an event is waiting
+ */
+bool
+XSource::pending (void)
+{
+    return XPending(display);
+}
+
+/**
+ * Wait for the next event
+ *
+ * If the wake-up descriptor becomes readable first, the event is INPUT_NONE
+ * and the descriptor is left for the caller to drain.
+ */
+void
+XSource::next_event (input_event_t &event)
+{
+    event.type = INPUT_NONE;
+    while ((wake_fd >= 0) && !XPending(display)) {
+        struct pollfd fds[2];
+        fds[0].fd = ConnectionNumber(display);
+        fds[0].events = POLLIN;
+        fds[1].fd = wake_fd;
+        fds[1].events = POLLIN;
+        if ((poll(fds, 2, -1) < 0) && (EINTR != errno)) {
+            break;
+        }
+        if (fds[1].revents & POLLIN) {
+            return;
+        }
+    }
+
+    XEvent xevent;
+    XNextEvent(display, &xevent);
+
+    if ((KeyPress == xevent.type) || (KeyRelease == xevent.type)) {
+        event.type = INPUT_KEY;
+        event.code = xevent.xkey.keycode;
+        event.pressed = (KeyPress == xevent.type);
+        event.time = server_time_ns(xevent.xkey.time);
+    } else if (monitors->handle_event(xevent)) {
+        event.type = INPUT_LAYOUT;
+    } else if (keymap->handle_event(xevent)) {
+        event.type = INPUT_KEYMAP;
+    } else {
+        windows->handle_event(xevent);
+    }
+}
+
+/**
+ * Ask for the keyboard state
+ */
+void
+XSource::request_keys (void)
+{
+    backend->request_keymap();
+}
+
+/**
+ * Get the held keys
+ */
+void
+XSource::query_keys (keyset_t &keys)
+{
+    char keymap[32];
+    backend->query_keymap(keymap);
+    keyset_from_bytes(keys, keymap);
+}
+
+/**
+ * Monotonic clock in nanoseconds
+ */
+uint64_t
+XSource::now (void)
+{
+    return framework::monotonic_ns();
+}
+
+/**
+ * Sleep until the given monotonic time
+ *
+ * The deadline is absolute, so the time the tick took is not added on top of
+ * the period, and a signal does not make us sleep any longer.
+ */
+void
+XSource::sleep_until (uint64_t deadline)
+{
+    struct timespec ts;
+    ts.tv_sec = deadline / 1000000000ULL;
+    ts.tv_nsec = deadline % 1000000000ULL;
+    while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts,
+                                    NULL)) {
+    }
+}
+
+/**
+ * The X server never runs out of input
+ */
+bool
+XSource::done (void)
+{
+    return false;
+}
@@ -0,0 +1,90 @@
+/*
+ *------------------------------------------------------------------------------
+ *
+ * xsource.h
+ *
+ * X server input source of project keymouse
+ *
+ * Copyright (c) 2017 Zoltan Toth <ztoth AT thetothfamily DOT net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *------------------------------------------------------------------------------
+ */
+#ifndef XSOURCE_H_
+#define XSOURCE_H_
+
+#include <X11/Xlib.h>
+
+#include "io.h"
+#include "backend.h"
+#include "monitors.h"
+#include "windows.h"
+#include "keymap.h"
+
+/**
+ * XSource class
+ *
+ * Input source of the polling loop on an X display: the core key events, the
+ * changes of the monitor layout, of the window geometry and of the keymap, and
+ * the keyboard state. The keyboard state is asked for through the Backend, so
+ * the XCB backend can pipeline the query. The wait for the next event is cut
+ * short when the wake-up descriptor becomes readable.
+ */
+class XSource : public InputSource {
+  public:
+    /**
+     * constructor, pass the display, the helpers already set up on it and the
+     * wake-up descriptor (-1 for none)
+     */
+    XSource (Display *display, Backend *backend, Monitors *monitors,
+             Windows *windows, Keymap *keymap, int wake_fd);
+
+    /** default destructor */
+    virtual ~XSource (void);
+
+    /** true if an event is waiting */
+    virtual bool pending (void);
+
+    /** wait for the next event */
+    virtual void next_event (input_event_t &event);
+
+    /** ask for the keyboard state */
+    virtual void request_keys (void);
+
+    /** get the held keys */
+    virtual void query_keys (keyset_t &keys);
+
+    /** monotonic clock in nanoseconds */
+    virtual uint64_t now (void);
+
+    /** sleep until the given monotonic time, in nanoseconds */
+    virtual void sleep_until (uint64_t deadline);
+
+    /** the X server never runs out of input */
+    virtual bool done (void);
+
+  private:
+    Display *display;                             /** X display connection */
+    Backend *backend;                             /** X requests */
+    Monitors *monitors;                           /** monitor layout cache */
+    Windows *windows;                             /** window geometry index */
+    Keymap *keymap;                               /** keymap copy */
+    int wake_fd;                                  /** ends the wait, or -1 */
+};
+
+/** monotonic time (nsec) of an X server timestamp */
+uint64_t server_time_ns (Time time);
+
+#endif /* XSOURCE_H_ */